@@ -0,0 +1,159 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include "wedopp.hpp"
+
+namespace
+{
+    template <class Function>
+    void measure(const char* name, const std::size_t iterations, Function function)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            function(i);
+        const auto duration = std::chrono::steady_clock::now() - start;
+
+        const auto nanoseconds = std::chrono::duration<double, std::nano>{duration}.count() / static_cast<double>(iterations);
+        std::cout << name << ": " << nanoseconds << " ns/op\n";
+    }
+
+    volatile std::uint32_t sink = 0U;
+
+    // a file that accepts every write, and that returns zeroed reports on Linux
+    wedopp::detail::File openMockFile()
+    {
+#ifdef _WIN32
+        return wedopp::detail::File{"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, 0};
+#else
+        return wedopp::detail::File{"/dev/zero", O_RDWR};
+#endif
+    }
+
+    void benchmarkDecoding()
+    {
+        measure("getDeviceType", 100000000U, [](const std::size_t i) {
+            sink = sink + static_cast<std::uint32_t>(wedopp::getDeviceType(static_cast<std::uint8_t>(i)));
+        });
+
+        std::array<std::uint8_t, 256> bytes;
+        std::array<wedopp::DeviceType, 256> types;
+        for (std::size_t i = 0; i < bytes.size(); ++i)
+            bytes[i] = static_cast<std::uint8_t>(i * 37U);
+
+        measure("getDeviceTypes (256 bytes)", 1000000U, [&bytes, &types](const std::size_t i) {
+            bytes[0] = static_cast<std::uint8_t>(i);
+            wedopp::getDeviceTypes(bytes.begin(), bytes.end(), types.begin());
+            sink = sink + static_cast<std::uint32_t>(types[i % types.size()]);
+        });
+
+        measure("snapshot parsing", 100000000U, [](const std::size_t i) {
+            const wedopp::HubSnapshot snapshot{{0U, 0U, 0U, static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(i >> 8U),
+                static_cast<std::uint8_t>(i >> 16U), static_cast<std::uint8_t>(i >> 24U), 0U, 0U}};
+            sink = sink + snapshot.getValue(0U) + snapshot.getValue(1U) +
+                static_cast<std::uint32_t>(snapshot.getType(0U)) + static_cast<std::uint32_t>(snapshot.getType(1U));
+        });
+    }
+
+    void benchmarkBatch()
+    {
+        constexpr std::size_t count = 512U;
+        std::array<std::uint8_t, count> values;
+        std::array<std::uint8_t, count> outputs;
+        std::array<std::uint64_t, count / 64U> mask;
+        for (std::size_t i = 0; i < values.size(); ++i)
+            values[i] = static_cast<std::uint8_t>(i * 37U);
+
+        measure("threshold mask per slot (512 slots)", 1000000U, [&values, &mask](const std::size_t i) {
+            values[0] = static_cast<std::uint8_t>(i);
+            mask.fill(0U);
+            for (std::size_t j = 0; j < values.size(); ++j)
+                if (values[j] <= 80U) mask[j / 64U] |= std::uint64_t{1U} << (j % 64U);
+            sink = sink + static_cast<std::uint32_t>(mask[i % mask.size()]);
+        });
+
+        measure("compareLE (512 slots)", 1000000U, [&values, &mask](const std::size_t i) {
+            values[0] = static_cast<std::uint8_t>(i);
+            wedopp::compareLE(values.data(), values.size(), 80U, mask.data());
+            sink = sink + static_cast<std::uint32_t>(mask[i % mask.size()]);
+        });
+
+        measure("selectOutputs (512 slots)", 1000000U, [&outputs, &mask](const std::size_t i) {
+            mask[0] = i;
+            wedopp::selectOutputs(mask.data(), outputs.size(), 127U, 0U, outputs.data());
+            sink = sink + outputs[i % outputs.size()];
+        });
+    }
+
+    void benchmarkMock()
+    {
+        wedopp::Hub hub{"mock", "mock", openMockFile()};
+        const auto& device = hub.getDevices()[0];
+
+        measure("setValue (unchanged)", 10000000U, [&device](const std::size_t) {
+            device.setValue(127U);
+        });
+
+        measure("setValue (changed)", 1000000U, [&device](const std::size_t i) {
+            device.setValue(static_cast<std::uint8_t>(i));
+        });
+
+        measure("beginUpdate/commit of two values", 1000000U, [&hub](const std::size_t i) {
+            hub.beginUpdate();
+            for (const auto& d : hub.getDevices())
+                d.setValue(static_cast<std::uint8_t>(i));
+            hub.commit();
+        });
+
+#ifndef _WIN32
+        measure("poll", 1000000U, [&hub](const std::size_t) {
+            sink = sink + hub.poll().getValue(0U);
+        });
+#endif
+    }
+
+    void benchmarkHub(wedopp::Hub& hub)
+    {
+        std::cout << "Hub " << hub.getName() << " at " << hub.getPath() << '\n';
+
+        const auto& device = hub.getDevices()[0];
+        hub.poll();
+
+        // round trip of an output report followed by the next input report
+        measure("round trip", 200U, [&hub, &device](const std::size_t i) {
+            device.setValue(static_cast<std::uint8_t>(i % 2U));
+            hub.poll();
+        });
+        device.setValue(0U);
+
+        std::size_t reports = 0U;
+        const auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::seconds{1})
+        {
+            hub.poll();
+            ++reports;
+        }
+        std::cout << "report rate: " << reports << " reports/s\n";
+    }
+}
+
+int main()
+{
+    try
+    {
+        benchmarkDecoding();
+        benchmarkBatch();
+        benchmarkMock();
+
+        std::error_code error;
+        auto hubs = wedopp::findHubs(error);
+        if (hubs.empty())
+            std::cout << "No WeDo hubs found, skipping the hub benchmarks\n";
+
+        for (auto& hub : hubs)
+            benchmarkHub(hub);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+    }
+}
@@ -1,8 +1,4 @@
 #include <iostream>
-#ifdef _WIN32
-#else
-#  include <unistd.h>
-#endif
 #include "wedopp.hpp"
 
 namespace
@@ -26,7 +22,7 @@ int main()
 {
     try
     {
-        const auto hubs = wedopp::findHubs();
+        auto hubs = wedopp::findHubs();
 
         if (!hubs.empty())
         {
@@ -40,29 +36,41 @@ int main()
                     std::cout << "  Device " << typeToString(device.getType()) << '\n';
             }
 
-            for (;;)
-            {
-                bool enable = false;
+            wedopp::HubGroup group{std::move(hubs)};
+
+            wedopp::ControlLoop loop{
+                wedopp::ControlLoopOptions{},
+                [&group]() {
+                    group.readAll(std::chrono::milliseconds{5});
+                },
+                [&group]() {
+                    const auto& types = group.getTypes();
+                    const auto& values = group.getValues();
+                    auto& outputs = group.getOutputs();
 
-                for (const auto& hub : hubs)
-                    for (const auto& device : hub.getDevices())
-                        if ((device.getType() == wedopp::Device::Type::distanceSensor || device.getType() == wedopp::Device::Type::tiltSensor) &&
-                            device.getValue() <= 80U)
+                    bool enable = false;
+                    for (std::size_t i = 0; i < types.size(); ++i)
+                        if ((types[i] == wedopp::Device::Type::distanceSensor ||
+                             types[i] == wedopp::Device::Type::tiltSensor) &&
+                            values[i] <= 80U)
                             enable = true;
 
-                for (const auto& hub : hubs)
-                    for (const auto& device : hub.getDevices())
-                        if (device.getType() == wedopp::Device::Type::motor ||
-                            device.getType() == wedopp::Device::Type::servoMotor ||
-                            device.getType() == wedopp::Device::Type::light)
-                            device.setValue(enable ? 127 : 0);
+                    for (std::size_t i = 0; i < types.size(); ++i)
+                        if (types[i] == wedopp::Device::Type::motor ||
+                            types[i] == wedopp::Device::Type::servoMotor ||
+                            types[i] == wedopp::Device::Type::light)
+                            outputs[i] = enable ? 127U : 0U;
+                },
+                [&group]() {
+                    group.writeAll();
+                }
+            };
 
-#ifdef _WIN32
-                Sleep(10);
-#else
-                sleep(10);
-#endif
-            }
+            loop.onOverrun([](std::uint64_t missed) {
+                std::cerr << "Missed " << missed << " periods\n";
+            });
+
+            loop.run();
         }
         else
             std::cout << "No WeDo hubs found\n";
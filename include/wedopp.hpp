@@ -1,10 +1,46 @@
 #ifndef WEDOPP_HPP
 #define WEDOPP_HPP
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
+
+// with WEDOPP_LIBRARY the enumeration and monitoring code is compiled once, in src/wedopp.cpp
+#if defined(WEDOPP_IMPLEMENTATION) && !defined(WEDOPP_LIBRARY)
+#  define WEDOPP_LIBRARY
+#endif
+
+#if !defined(WEDOPP_LIBRARY) || defined(WEDOPP_IMPLEMENTATION)
+#  define WEDOPP_SOURCES
+#endif
+
+#ifdef WEDOPP_LIBRARY
+#  define WEDOPP_INLINE
+#else
+#  define WEDOPP_INLINE inline
+#endif
+
 #ifdef _WIN32
 #  pragma push_macro("WIN32_LEAN_AND_MEAN")
 #  pragma push_macro("NOMINMAX")
@@ -15,23 +51,329 @@
 #    define NOMINMAX
 #  endif // NOMINMAX
 #  include <Windows.h>
-#  include <hidsdi.h>
-#  include <SetupAPI.h>
+#  ifdef WEDOPP_SOURCES
+#    include <Dbt.h>
+#    include <hidsdi.h>
+#    include <SetupAPI.h>
+#  endif // WEDOPP_SOURCES
 #  pragma pop_macro("WIN32_LEAN_AND_MEAN")
 #  pragma pop_macro("NOMINMAX")
 #else
-#  include <cstring>
-#  include <dirent.h>
+#  include <climits>
 #  include <fcntl.h>
-#  include <linux/hiddev.h>
-#  include <sys/ioctl.h>
+#  include <poll.h>
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/mman.h>
+#  include <time.h>
+#  include <unistd.h>
+#  ifdef WEDOPP_SOURCES
+#    include <dirent.h>
+#    include <linux/hiddev.h>
+#    include <linux/netlink.h>
+#    include <sys/ioctl.h>
+#    include <sys/socket.h>
+#  endif // WEDOPP_SOURCES
+#endif
+
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+#  define WEDOPP_EXCEPTIONS
+#endif
+
+#ifndef WEDOPP_NO_SIMD
+#  if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define WEDOPP_SSE2
+#  elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#    include <arm_neon.h>
+#    define WEDOPP_NEON
+#  endif
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#  include <coroutine>
+#  define WEDOPP_COROUTINES
+#endif
+
+// the options that change the inline code are part of the mangled names, so mixing them is a link error
+#if defined(WEDOPP_COROUTINES) && defined(WEDOPP_STATS)
+#  define WEDOPP_ABI abi_coroutines_stats
+#elif defined(WEDOPP_COROUTINES)
+#  define WEDOPP_ABI abi_coroutines
+#elif defined(WEDOPP_STATS)
+#  define WEDOPP_ABI abi_stats
+#else
+#  define WEDOPP_ABI abi
 #endif
 
 namespace wedopp
 {
+inline namespace WEDOPP_ABI
+{
+    enum class DeviceType: std::uint8_t
+    {
+        none,
+        motor,
+        servoMotor,
+        light,
+        distanceSensor,
+        tiltSensor
+    };
+
+    namespace detail
+    {
+        constexpr DeviceType decodeDeviceType(const std::uint8_t b) noexcept
+        {
+            switch (b)
+            {
+            case 38U:
+            case 39U:
+                return DeviceType::tiltSensor;
+
+            case 102U:
+            case 103U:
+                return DeviceType::servoMotor;
+
+            case 177U:
+            case 178U:
+            case 179U:
+            case 180U:
+                return DeviceType::distanceSensor;
+
+            case 202U:
+            case 203U:
+            case 204U:
+            case 205U:
+                return DeviceType::light;
+
+            case 231U:
+                return DeviceType::none;
+
+            case 0U:
+            case 1U:
+            case 2U:
+            case 3U:
+            case 239U:
+            case 240U:
+            case 241U:
+                return DeviceType::motor;
+
+            default: return DeviceType::none;
+            }
+        }
+
+        constexpr std::array<DeviceType, 256> generateDeviceTypes() noexcept
+        {
+            std::array<DeviceType, 256> table{};
+            for (std::size_t i = 0; i < table.size(); ++i)
+                table[i] = decodeDeviceType(static_cast<std::uint8_t>(i));
+            return table;
+        }
+
+        inline constexpr auto deviceTypes = generateDeviceTypes();
+    }
+
+    [[nodiscard]] constexpr DeviceType getDeviceType(const std::uint8_t b) noexcept
+    {
+        return detail::deviceTypes[b];
+    }
+
+    template <class InputIterator, class OutputIterator>
+    constexpr OutputIterator getDeviceTypes(InputIterator first, const InputIterator last, OutputIterator result)
+    {
+        for (; first != last; ++first, ++result)
+            *result = getDeviceType(static_cast<std::uint8_t>(*first));
+        return result;
+    }
+
+    enum class TiltDirection: std::uint8_t
+    {
+        level,
+        forward,
+        back,
+        left,
+        right
+    };
+
+    namespace detail
+    {
+        constexpr TiltDirection decodeTiltDirection(const std::uint8_t value) noexcept
+        {
+            if (value < 49U) return TiltDirection::back;
+            if (value < 100U) return TiltDirection::right;
+            if (value < 154U) return TiltDirection::level;
+            if (value < 186U) return TiltDirection::forward;
+            return TiltDirection::left;
+        }
+
+        // the sensor does not report values below 69
+        constexpr std::uint8_t decodeDistance(const std::uint8_t value) noexcept
+        {
+            return value < 69U ? 0U : static_cast<std::uint8_t>(value - 69U);
+        }
+
+        template <class T, T decode(std::uint8_t) noexcept>
+        constexpr std::array<T, 256> generateTable() noexcept
+        {
+            std::array<T, 256> table{};
+            for (std::size_t i = 0; i < table.size(); ++i)
+                table[i] = decode(static_cast<std::uint8_t>(i));
+            return table;
+        }
+
+        inline constexpr auto tiltDirections = generateTable<TiltDirection, decodeTiltDirection>();
+        inline constexpr auto distances = generateTable<std::uint8_t, decodeDistance>();
+    }
+
+    // Value is what a sensor reads or an actuator is set to, with the conversions from and to raw hub values
+    template <DeviceType type>
+    struct DeviceTraits;
+
+    template <>
+    struct DeviceTraits<DeviceType::distanceSensor> final
+    {
+        using Value = std::uint8_t;
+        static constexpr bool isSensor = true;
+        static constexpr bool isActuator = false;
+        [[nodiscard]] static constexpr Value decode(const std::uint8_t raw) noexcept { return detail::distances[raw]; }
+    };
+
+    template <>
+    struct DeviceTraits<DeviceType::tiltSensor> final
+    {
+        using Value = TiltDirection;
+        static constexpr bool isSensor = true;
+        static constexpr bool isActuator = false;
+        [[nodiscard]] static constexpr Value decode(const std::uint8_t raw) noexcept { return detail::tiltDirections[raw]; }
+    };
+
+    // the sign of the speed is the direction, and -128 is treated as -127
+    template <>
+    struct DeviceTraits<DeviceType::motor> final
+    {
+        using Value = std::int8_t;
+        static constexpr bool isSensor = false;
+        static constexpr bool isActuator = true;
+        [[nodiscard]] static constexpr Value decode(const std::uint8_t raw) noexcept { return static_cast<Value>(raw); }
+        [[nodiscard]] static constexpr std::uint8_t encode(const Value speed) noexcept
+        {
+            return static_cast<std::uint8_t>(speed < -127 ? -127 : speed);
+        }
+    };
+
+    template <>
+    struct DeviceTraits<DeviceType::servoMotor> final
+    {
+        using Value = std::int8_t;
+        static constexpr bool isSensor = false;
+        static constexpr bool isActuator = true;
+        [[nodiscard]] static constexpr Value decode(const std::uint8_t raw) noexcept { return static_cast<Value>(raw); }
+        [[nodiscard]] static constexpr std::uint8_t encode(const Value position) noexcept
+        {
+            return static_cast<std::uint8_t>(position < -127 ? -127 : position);
+        }
+    };
+
+    // brightness from 0 to 127
+    template <>
+    struct DeviceTraits<DeviceType::light> final
+    {
+        using Value = std::uint8_t;
+        static constexpr bool isSensor = false;
+        static constexpr bool isActuator = true;
+        [[nodiscard]] static constexpr Value decode(const std::uint8_t raw) noexcept { return raw; }
+        [[nodiscard]] static constexpr std::uint8_t encode(const Value brightness) noexcept
+        {
+            return brightness > 127U ? 127U : brightness;
+        }
+    };
+
+    static_assert(DeviceTraits<DeviceType::tiltSensor>::decode(128U) == TiltDirection::level);
+    static_assert(DeviceTraits<DeviceType::distanceSensor>::decode(80U) == 11U);
+    static_assert(DeviceTraits<DeviceType::motor>::encode(-1) == 255U);
+    static_assert(DeviceTraits<DeviceType::motor>::decode(255U) == -1);
+
+    class HubSnapshot final
+    {
+    public:
+        HubSnapshot() noexcept = default;
+        explicit HubSnapshot(const std::array<std::uint8_t, 9>& r,
+                             const std::chrono::steady_clock::time_point t = {}) noexcept:
+            report{r}, time{t}
+        {}
+
+        [[nodiscard]] auto getType(std::uint8_t slot) const noexcept
+        {
+            return getDeviceType(report[4U + slot * 2U]);
+        }
+
+        [[nodiscard]] std::uint8_t getValue(std::uint8_t slot) const noexcept
+        {
+            return report[3U + slot * 2U];
+        }
+
+        [[nodiscard]] const auto& getReport() const noexcept { return report; }
+        [[nodiscard]] auto getTime() const noexcept { return time; }
+
+    private:
+        std::array<std::uint8_t, 9> report{};
+        std::chrono::steady_clock::time_point time{};
+    };
+
+    // all counters stay zero unless WEDOPP_STATS is defined
+    struct HubStats final
+    {
+        std::uint64_t reads = 0U;
+        std::uint64_t writes = 0U;
+        std::uint64_t bytesRead = 0U;
+        std::uint64_t bytesWritten = 0U;
+        std::uint64_t errors = 0U;
+        std::uint64_t timeouts = 0U;
+        std::uint64_t skippedWrites = 0U;
+        // bucket i counts blocking operations that took less than 2^i microseconds and at least 2^(i-1)
+        std::array<std::uint64_t, 24> readLatency{};
+        std::array<std::uint64_t, 24> writeLatency{};
+        std::chrono::steady_clock::time_point time{};
+    };
+
+    // the layout of a report in a recording, in host byte order
+    struct RecordedReport final
+    {
+        enum class Direction: std::uint8_t
+        {
+            none, // past the end of a recording that was not closed
+            input,
+            output
+        };
+
+        std::uint64_t time; // nanoseconds since the recording started
+        std::array<std::uint8_t, 9> report;
+        Direction direction;
+        std::array<std::uint8_t, 6> reserved;
+    };
+
+    static_assert(sizeof(RecordedReport) == 24U);
+
     namespace detail
     {
+        inline constexpr auto infinite = std::chrono::milliseconds::max();
+        inline constexpr std::size_t reportSize = 9U;
+
+        template <class Exception>
+        [[noreturn]] void raise(const Exception& exception)
+        {
+#ifdef WEDOPP_EXCEPTIONS
+            throw exception;
+#else
+            static_cast<void>(exception);
+            std::abort();
+#endif
+        }
+
 #ifdef _WIN32
+#ifdef WEDOPP_SOURCES
         class InterfaceDetailData final
         {
         public:
@@ -39,7 +381,7 @@ namespace wedopp
                 data{static_cast<SP_DEVICE_INTERFACE_DETAIL_DATA_A*>(std::malloc(size))}
             {
                 if (!data)
-                    throw std::bad_alloc{};
+                    detail::raise(std::bad_alloc{});
 
                 data->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA_A);
             }
@@ -72,375 +414,4791 @@ namespace wedopp
         private:
             SP_DEVICE_INTERFACE_DETAIL_DATA_A* data = nullptr;
         };
+#endif
 
-        class File final
+        class Event final
         {
         public:
-            File(const std::string& filename, const DWORD desiredAccess, const DWORD shareMode, const DWORD creationDisposition, const DWORD flagsAndAttributes):
-                handle{CreateFileA(filename.c_str(), desiredAccess, shareMode, nullptr, creationDisposition, flagsAndAttributes, nullptr)}
+            explicit Event(const bool create):
+                handle{create ? CreateEventA(nullptr, TRUE, FALSE, nullptr) : nullptr}
             {
-                if (handle == INVALID_HANDLE_VALUE)
-                    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to open file"};
+                if (create && !handle)
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to create event"});
             }
 
-            ~File()
+            Event(const bool create, std::error_code& error) noexcept:
+                handle{create && !error ? CreateEventA(nullptr, TRUE, FALSE, nullptr) : nullptr}
             {
-                if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+                if (create && !error && !handle)
+                    error.assign(static_cast<int>(GetLastError()), std::system_category());
             }
 
-            File(File&& other) noexcept: handle{other.handle}
+            ~Event()
             {
-                other.handle = INVALID_HANDLE_VALUE;
+                if (handle) CloseHandle(handle);
             }
 
-            File& operator=(File&& other) noexcept
+            Event(Event&& other) noexcept: handle{other.handle}
+            {
+                other.handle = nullptr;
+            }
+
+            Event& operator=(Event&& other) noexcept
             {
                 if (this != &other)
                 {
+                    if (handle) CloseHandle(handle);
                     handle = other.handle;
-                    other.handle = INVALID_HANDLE_VALUE;
+                    other.handle = nullptr;
                 }
                 return *this;
             }
 
             [[nodiscard]] auto get() const noexcept { return handle; }
 
-            template <std::size_t n>
-            void write(const std::array<std::uint8_t, n>& data) const
+        private:
+            HANDLE handle = nullptr;
+        };
+
+        struct AsyncOperation final: OVERLAPPED
+        {
+            AsyncOperation(HANDLE f,
+                           std::function<void(const std::error_code&, std::size_t)> c,
+                           const std::chrono::steady_clock::time_point d):
+                OVERLAPPED{}, file{f}, callback{std::move(c)}, deadline{d}
+            {}
+
+            HANDLE file = INVALID_HANDLE_VALUE;
+            std::function<void(const std::error_code&, std::size_t)> callback;
+            std::chrono::steady_clock::time_point deadline;
+            bool timedOut = false;
+        };
+
+        class CompletionPort final
+        {
+        public:
+            CompletionPort():
+                handle{CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0)}
             {
-                if (!WriteFile(handle, data.data(), static_cast<DWORD>(data.size()), nullptr, nullptr))
-                    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to write to file"};
+                if (!handle)
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to create completion port"});
             }
 
-            template <std::size_t n>
-            void read(std::array<std::uint8_t, n>& data) const
+            ~CompletionPort()
             {
-                if (!ReadFile(handle, data.data(), static_cast<DWORD>(data.size()), nullptr, nullptr))
-                    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to read from file"};
+                if (handle) CloseHandle(handle);
             }
 
-        private:
-            HANDLE handle = INVALID_HANDLE_VALUE;
-        };
+            CompletionPort(const CompletionPort&) = delete;
+            CompletionPort& operator=(const CompletionPort&) = delete;
 
-        class DevInfo final
-        {
-        public:
-            DevInfo(const GUID* guid, const DWORD flags):
-                handle{SetupDiGetClassDevs(guid, nullptr, nullptr, flags)}
+            [[nodiscard]] auto get() const noexcept { return handle; }
+
+            void associate(HANDLE file)
             {
-                if (handle == INVALID_HANDLE_VALUE)
-                    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to get devices"};
+                if (!CreateIoCompletionPort(file, handle, 0, 0))
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to associate file with completion port"});
             }
 
-            ~DevInfo()
+            AsyncOperation* submit(HANDLE file,
+                                   std::function<void(const std::error_code&, std::size_t)> callback,
+                                   const std::chrono::milliseconds timeout)
             {
-                if (handle != INVALID_HANDLE_VALUE) SetupDiDestroyDeviceInfoList(handle);
+                const auto deadline = timeout == infinite ?
+                    std::chrono::steady_clock::time_point::max() :
+                    std::chrono::steady_clock::now() + timeout;
+
+                auto operation = std::make_unique<AsyncOperation>(file, std::move(callback), deadline);
+                std::lock_guard lock{mutex};
+                pending.push_back(operation.get());
+                return operation.release();
             }
 
-            DevInfo(DevInfo&& other) noexcept: handle{other.handle}
+            void discard(AsyncOperation* operation) noexcept
             {
-                other.handle = INVALID_HANDLE_VALUE;
+                std::unique_ptr<AsyncOperation> owner{operation};
+                std::lock_guard lock{mutex};
+                pending.erase(std::remove(pending.begin(), pending.end(), operation), pending.end());
             }
 
-            DevInfo& operator=(DevInfo&& other) noexcept
+            void stop()
             {
-                if (this != &other)
+                if (!PostQueuedCompletionStatus(handle, 0, stopKey, nullptr))
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to post to completion port"});
+            }
+
+            void run()
+            {
+                while (runOnce(infinite));
+            }
+
+            bool runOnce(const std::chrono::milliseconds timeout)
+            {
+                std::error_code error;
+                const auto result = runOnce(timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to get completion status"});
+                return result;
+            }
+
+            bool runOnce(const std::chrono::milliseconds timeout, std::error_code& status)
+            {
+                status.clear();
+
+                DWORD bytes = 0;
+                ULONG_PTR key = 0;
+                LPOVERLAPPED overlapped = nullptr;
+                const auto result = GetQueuedCompletionStatus(handle, &bytes, &key, &overlapped, getWaitTime(timeout));
+                const auto error = result ? ERROR_SUCCESS : GetLastError();
+
+                if (!overlapped)
                 {
-                    handle = other.handle;
-                    other.handle = INVALID_HANDLE_VALUE;
+                    if (!result)
+                    {
+                        if (error != WAIT_TIMEOUT)
+                        {
+                            status.assign(static_cast<int>(error), std::system_category());
+                            return false;
+                        }
+
+                        cancelExpired();
+                        return true;
+                    }
+
+                    return key != stopKey;
                 }
-                return *this;
+
+                std::unique_ptr<AsyncOperation> operation{static_cast<AsyncOperation*>(overlapped)};
+                {
+                    std::lock_guard lock{mutex};
+                    pending.erase(std::remove(pending.begin(), pending.end(), operation.get()), pending.end());
+                }
+
+                if (result)
+                    operation->callback(std::error_code{}, bytes);
+                else if (operation->timedOut && error == ERROR_OPERATION_ABORTED)
+                    operation->callback(std::make_error_code(std::errc::timed_out), bytes);
+                else
+                    operation->callback(std::error_code{static_cast<int>(error), std::system_category()}, bytes);
+
+                return true;
             }
-            
-            [[nodiscard]] auto get() const noexcept { return handle; }
 
         private:
-            HDEVINFO handle = INVALID_HANDLE_VALUE;
+            static constexpr ULONG_PTR stopKey = 1U;
+
+            DWORD getWaitTime(const std::chrono::milliseconds timeout)
+            {
+                auto deadline = timeout == infinite ?
+                    std::chrono::steady_clock::time_point::max() :
+                    std::chrono::steady_clock::now() + timeout;
+
+                {
+                    std::lock_guard lock{mutex};
+                    for (const auto operation : pending)
+                        if (!operation->timedOut && operation->deadline < deadline)
+                            deadline = operation->deadline;
+                }
+
+                if (deadline == std::chrono::steady_clock::time_point::max()) return INFINITE;
+
+                const auto now = std::chrono::steady_clock::now();
+                if (deadline <= now) return 0;
+
+                const auto duration = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+                return duration >= INFINITE ? INFINITE - 1U : static_cast<DWORD>(duration);
+            }
+
+            void cancelExpired() noexcept
+            {
+                const auto now = std::chrono::steady_clock::now();
+
+                std::lock_guard lock{mutex};
+                for (const auto operation : pending)
+                    if (!operation->timedOut && operation->deadline <= now)
+                    {
+                        operation->timedOut = true;
+                        CancelIoEx(operation->file, operation);
+                    }
+            }
+
+            HANDLE handle = nullptr;
+            std::mutex mutex;
+            std::vector<AsyncOperation*> pending;
         };
-#else
+
         class File final
         {
         public:
-            File(const std::string& filename, int flags): fd{open(filename.c_str(), flags)}
+            File(const std::string& filename, const DWORD desiredAccess, const DWORD shareMode, const DWORD creationDisposition, const DWORD flagsAndAttributes):
+                readEvent{(flagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0},
+                writeEvent{(flagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0},
+                handle{CreateFileA(filename.c_str(), desiredAccess, shareMode, nullptr, creationDisposition, flagsAndAttributes, nullptr)}
             {
-                if (fd == -1)
-                    throw std::system_error{errno, std::system_category(), "Failed to open file"};
+                if (handle == INVALID_HANDLE_VALUE)
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to open file"});
+            }
+
+            File(const std::string& filename, const DWORD desiredAccess, const DWORD shareMode, const DWORD creationDisposition, const DWORD flagsAndAttributes,
+                 std::error_code& error) noexcept:
+                readEvent{(error.clear(), (flagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0), error},
+                writeEvent{(flagsAndAttributes & FILE_FLAG_OVERLAPPED) != 0, error},
+                handle{error ? INVALID_HANDLE_VALUE : CreateFileA(filename.c_str(), desiredAccess, shareMode, nullptr, creationDisposition, flagsAndAttributes, nullptr)}
+            {
+                if (!error && handle == INVALID_HANDLE_VALUE)
+                    error.assign(static_cast<int>(GetLastError()), std::system_category());
             }
 
             ~File()
             {
-                if (fd != -1) close(fd);
+                if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
             }
 
-            File(File&& other) noexcept: fd{other.fd}
+            File(File&& other) noexcept:
+                readEvent{std::move(other.readEvent)},
+                writeEvent{std::move(other.writeEvent)},
+                handle{other.handle}
             {
-                other.fd = -1;
+                other.handle = INVALID_HANDLE_VALUE;
             }
 
             File& operator=(File&& other) noexcept
             {
                 if (this != &other)
                 {
-                    fd = other.fd;
-                    other.fd = -1;
+                    if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+                    readEvent = std::move(other.readEvent);
+                    writeEvent = std::move(other.writeEvent);
+                    handle = other.handle;
+                    other.handle = INVALID_HANDLE_VALUE;
                 }
                 return *this;
             }
 
-            [[nodiscard]] auto get() const noexcept { return fd; }
+            [[nodiscard]] auto get() const noexcept { return handle; }
+            [[nodiscard]] bool isOverlapped() const noexcept { return readEvent.get() != nullptr; }
 
             template <std::size_t n>
             void write(const std::array<std::uint8_t, n>& data) const
             {
-                if (::write(fd, data.data(), data.size()) == -1)
-                    throw std::system_error{errno, std::system_category(), "Failed to write to file"};
+                write(data, infinite);
             }
 
             template <std::size_t n>
-            void read(std::array<std::uint8_t, n>& data) const
+            void write(const std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout) const
             {
-                if (::read(fd, data.data(), data.size()) == -1)
-                    throw std::system_error{errno, std::system_category(), "Failed to read from file"};
+                std::error_code error;
+                write(data, timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
             }
 
-        private:
-            int fd = -1;
-        };
-#endif
-
-        class Processor final
-        {
-        public:
-            Processor(File f) noexcept: file{std::move(f)} {}
-
-            std::uint8_t readType(std::uint8_t slot)
+            template <std::size_t n>
+            void write(const std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
             {
-                file.read(readBuffer);
-                return readBuffer[4U + slot * 2U];
+                write(data.data(), data.size(), timeout, error);
             }
 
-            std::uint8_t readValue(std::uint8_t slot)
+            void write(const std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
             {
-                file.read(readBuffer);
-                return readBuffer[3U + slot * 2U];
-            }
+                error.clear();
+
+                if (!isOverlapped())
+                {
+                    if (!WriteFile(handle, data, static_cast<DWORD>(size), nullptr, nullptr))
+                        error.assign(static_cast<int>(GetLastError()), std::system_category());
+                    return;
+                }
+
+                OVERLAPPED overlapped{};
+                overlapped.hEvent = getEventHandle(writeEvent);
+                if (!WriteFile(handle, data, static_cast<DWORD>(size), nullptr, &overlapped))
+                    if (const auto result = GetLastError(); result != ERROR_IO_PENDING)
+                    {
+                        error.assign(static_cast<int>(result), std::system_category());
+                        return;
+                    }
+
+                wait(overlapped, writeEvent, timeout, error);
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data) const
+            {
+                read(data, infinite);
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout) const
+            {
+                std::error_code error;
+                read(data, timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                read(data.data(), data.size(), timeout, error);
+            }
+
+            void read(std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                error.clear();
+
+                if (!isOverlapped())
+                {
+                    if (!ReadFile(handle, data, static_cast<DWORD>(size), nullptr, nullptr))
+                        error.assign(static_cast<int>(GetLastError()), std::system_category());
+                    return;
+                }
+
+                OVERLAPPED overlapped;
+                startRead(data, size, overlapped, error);
+                if (!error) wait(overlapped, readEvent, timeout, error);
+            }
+
+            // the read must be finished with finishRead before the next one is started
+            void startRead(std::uint8_t* data, const std::size_t size, OVERLAPPED& overlapped, std::error_code& error) const noexcept
+            {
+                error.clear();
+                overlapped = OVERLAPPED{};
+                overlapped.hEvent = getEventHandle(readEvent);
+                if (!ReadFile(handle, data, static_cast<DWORD>(size), nullptr, &overlapped))
+                    if (const auto result = GetLastError(); result != ERROR_IO_PENDING)
+                        error.assign(static_cast<int>(result), std::system_category());
+            }
+
+            void finishRead(OVERLAPPED& overlapped, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                error.clear();
+                wait(overlapped, readEvent, timeout, error);
+            }
+
+            // the write is signaled on its own event, so that it can be in flight while write is called
+            void startWrite(const std::uint8_t* data, const std::size_t size, OVERLAPPED& overlapped, const Event& event, std::error_code& error) const noexcept
+            {
+                error.clear();
+                overlapped = OVERLAPPED{};
+                overlapped.hEvent = getEventHandle(event);
+                if (!WriteFile(handle, data, static_cast<DWORD>(size), nullptr, &overlapped))
+                    if (const auto result = GetLastError(); result != ERROR_IO_PENDING)
+                        error.assign(static_cast<int>(result), std::system_category());
+            }
+
+            void finishWrite(OVERLAPPED& overlapped, const Event& event, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                error.clear();
+                wait(overlapped, event, timeout, error);
+            }
+
+            // data must stay valid until the callback has been called
+            template <std::size_t n>
+            void writeAsync(const std::array<std::uint8_t, n>& data,
+                            CompletionPort& port,
+                            std::function<void(const std::error_code&, std::size_t)> callback,
+                            const std::chrono::milliseconds timeout = infinite) const
+            {
+                std::error_code error;
+                writeAsync(data, port, std::move(callback), timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
+            }
+
+            template <std::size_t n>
+            void writeAsync(const std::array<std::uint8_t, n>& data,
+                            CompletionPort& port,
+                            std::function<void(const std::error_code&, std::size_t)> callback,
+                            const std::chrono::milliseconds timeout,
+                            std::error_code& error) const
+            {
+                error.clear();
+                const auto operation = port.submit(handle, std::move(callback), timeout);
+                if (!WriteFile(handle, data.data(), static_cast<DWORD>(data.size()), nullptr, operation))
+                    if (const auto result = GetLastError(); result != ERROR_IO_PENDING)
+                    {
+                        port.discard(operation);
+                        error.assign(static_cast<int>(result), std::system_category());
+                    }
+            }
+
+            // data must stay valid until the callback has been called
+            template <std::size_t n>
+            void readAsync(std::array<std::uint8_t, n>& data,
+                           CompletionPort& port,
+                           std::function<void(const std::error_code&, std::size_t)> callback,
+                           const std::chrono::milliseconds timeout = infinite) const
+            {
+                std::error_code error;
+                readAsync(data, port, std::move(callback), timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+            }
+
+            template <std::size_t n>
+            void readAsync(std::array<std::uint8_t, n>& data,
+                           CompletionPort& port,
+                           std::function<void(const std::error_code&, std::size_t)> callback,
+                           const std::chrono::milliseconds timeout,
+                           std::error_code& error) const
+            {
+                error.clear();
+                const auto operation = port.submit(handle, std::move(callback), timeout);
+                if (!ReadFile(handle, data.data(), static_cast<DWORD>(data.size()), nullptr, operation))
+                    if (const auto result = GetLastError(); result != ERROR_IO_PENDING)
+                    {
+                        port.discard(operation);
+                        error.assign(static_cast<int>(result), std::system_category());
+                    }
+            }
+
+        private:
+            // setting the low-order bit keeps the completion from being queued to a completion port
+            static HANDLE getEventHandle(const Event& event) noexcept
+            {
+                return reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(event.get()) | 1U);
+            }
+
+            void wait(OVERLAPPED& overlapped, const Event& event, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                const auto milliseconds = timeout >= std::chrono::milliseconds{INFINITE} ?
+                    INFINITE : static_cast<DWORD>(timeout.count());
+
+                DWORD bytes = 0;
+                if (const auto result = WaitForSingleObject(event.get(), milliseconds); result != WAIT_OBJECT_0)
+                {
+                    const auto waitError = result == WAIT_FAILED ? GetLastError() : ERROR_TIMEOUT;
+                    CancelIoEx(handle, &overlapped);
+                    if (GetOverlappedResult(handle, &overlapped, &bytes, TRUE)) return;
+
+                    if (waitError == ERROR_TIMEOUT)
+                        error = std::make_error_code(std::errc::timed_out);
+                    else
+                        error.assign(static_cast<int>(waitError), std::system_category());
+                    return;
+                }
+
+                if (!GetOverlappedResult(handle, &overlapped, &bytes, FALSE))
+                    error.assign(static_cast<int>(GetLastError()), std::system_category());
+            }
+
+            Event readEvent;
+            Event writeEvent;
+            HANDLE handle = INVALID_HANDLE_VALUE;
+        };
+
+#ifdef WEDOPP_SOURCES
+        class DevInfo final
+        {
+        public:
+            DevInfo(const GUID* guid, const DWORD flags):
+                handle{SetupDiGetClassDevs(guid, nullptr, nullptr, flags)}
+            {
+                if (handle == INVALID_HANDLE_VALUE)
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to get devices"});
+            }
+
+            DevInfo(const GUID* guid, const DWORD flags, std::error_code& error) noexcept:
+                handle{SetupDiGetClassDevs(guid, nullptr, nullptr, flags)}
+            {
+                error = handle == INVALID_HANDLE_VALUE ?
+                    std::error_code{static_cast<int>(GetLastError()), std::system_category()} :
+                    std::error_code{};
+            }
+
+            ~DevInfo()
+            {
+                if (handle != INVALID_HANDLE_VALUE) SetupDiDestroyDeviceInfoList(handle);
+            }
+
+            DevInfo(DevInfo&& other) noexcept: handle{other.handle}
+            {
+                other.handle = INVALID_HANDLE_VALUE;
+            }
+
+            DevInfo& operator=(DevInfo&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    handle = other.handle;
+                    other.handle = INVALID_HANDLE_VALUE;
+                }
+                return *this;
+            }
+            
+            [[nodiscard]] auto get() const noexcept { return handle; }
+
+        private:
+            HDEVINFO handle = INVALID_HANDLE_VALUE;
+        };
+#endif
+#else
+        class File final
+        {
+        public:
+            File(const std::string& filename, int flags): fd{open(filename.c_str(), flags)}
+            {
+                if (fd == -1)
+                    detail::raise(std::system_error{errno, std::system_category(), "Failed to open file"});
+            }
+
+            File(const std::string& filename, int flags, std::error_code& error) noexcept:
+                fd{open(filename.c_str(), flags)}
+            {
+                error = fd == -1 ? std::error_code{errno, std::system_category()} : std::error_code{};
+            }
+
+            ~File()
+            {
+                if (fd != -1) close(fd);
+            }
+
+            File(File&& other) noexcept: fd{other.fd}
+            {
+                other.fd = -1;
+            }
+
+            File& operator=(File&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    if (fd != -1) close(fd);
+                    fd = other.fd;
+                    other.fd = -1;
+                }
+                return *this;
+            }
+
+            [[nodiscard]] auto get() const noexcept { return fd; }
+
+            void setNonBlocking(const bool nonBlocking) const
+            {
+                const auto flags = fcntl(fd, F_GETFL);
+                if (flags == -1)
+                    detail::raise(std::system_error{errno, std::system_category(), "Failed to get file flags"});
+
+                if (fcntl(fd, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == -1)
+                    detail::raise(std::system_error{errno, std::system_category(), "Failed to set file flags"});
+            }
+
+            template <std::size_t n>
+            void write(const std::array<std::uint8_t, n>& data) const
+            {
+                write(data, infinite);
+            }
+
+            template <std::size_t n>
+            void write(const std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout) const
+            {
+                std::error_code error;
+                write(data, timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
+            }
+
+            template <std::size_t n>
+            void write(const std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                write(data.data(), data.size(), timeout, error);
+            }
+
+            void write(const std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                while (!tryWrite(data, size, error) && !error)
+                    wait(POLLOUT, timeout, error);
+            }
+
+            template <std::size_t n>
+            bool tryWrite(const std::array<std::uint8_t, n>& data) const
+            {
+                std::error_code error;
+                const auto result = tryWrite(data, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
+                return result;
+            }
+
+            template <std::size_t n>
+            bool tryWrite(const std::array<std::uint8_t, n>& data, std::error_code& error) const noexcept
+            {
+                return tryWrite(data.data(), data.size(), error);
+            }
+
+            bool tryWrite(const std::uint8_t* data, const std::size_t size, std::error_code& error) const noexcept
+            {
+                error.clear();
+                if (::write(fd, data, size) == -1)
+                {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        error.assign(errno, std::system_category());
+                    return false;
+                }
+                return true;
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data) const
+            {
+                read(data, infinite);
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout) const
+            {
+                std::error_code error;
+                read(data, timeout, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+            }
+
+            template <std::size_t n>
+            void read(std::array<std::uint8_t, n>& data, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                read(data.data(), data.size(), timeout, error);
+            }
+
+            void read(std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                while (!tryRead(data, size, error) && !error)
+                    wait(POLLIN, timeout, error);
+            }
+
+            template <std::size_t n>
+            bool tryRead(std::array<std::uint8_t, n>& data) const
+            {
+                std::error_code error;
+                const auto result = tryRead(data, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+                return result;
+            }
+
+            template <std::size_t n>
+            bool tryRead(std::array<std::uint8_t, n>& data, std::error_code& error) const noexcept
+            {
+                return tryRead(data.data(), data.size(), error);
+            }
+
+            bool tryRead(std::uint8_t* data, const std::size_t size, std::error_code& error) const noexcept
+            {
+                error.clear();
+                if (::read(fd, data, size) == -1)
+                {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        error.assign(errno, std::system_category());
+                    return false;
+                }
+                return true;
+            }
+
+        private:
+            void wait(const short events, const std::chrono::milliseconds timeout, std::error_code& error) const noexcept
+            {
+                const auto milliseconds = timeout == infinite ? -1 :
+                    static_cast<int>(std::min(timeout.count(), static_cast<std::chrono::milliseconds::rep>(INT_MAX)));
+
+                pollfd pollFd{fd, events, 0};
+                for (;;)
+                {
+                    if (const auto result = poll(&pollFd, 1, milliseconds); result == -1)
+                    {
+                        if (errno != EINTR)
+                        {
+                            error.assign(errno, std::system_category());
+                            return;
+                        }
+                    }
+                    else
+                    {
+                        if (result == 0) error = std::make_error_code(std::errc::timed_out);
+                        return;
+                    }
+                }
+            }
+
+            int fd = -1;
+        };
+#endif
+
+        class ReportCell final
+        {
+        public:
+            void store(const HubSnapshot& snapshot) noexcept
+            {
+                sequence.fetch_add(1U, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                const auto& report = snapshot.getReport();
+                for (std::size_t i = 0; i < report.size(); ++i)
+                    data[i].store(report[i], std::memory_order_relaxed);
+                time.store(snapshot.getTime().time_since_epoch().count(), std::memory_order_relaxed);
+
+                sequence.fetch_add(1U, std::memory_order_release);
+            }
+
+            [[nodiscard]] HubSnapshot load() const noexcept
+            {
+                HubSnapshot snapshot;
+                load(snapshot);
+                return snapshot;
+            }
+
+            // returns the number of completed stores times two
+            std::uint32_t load(HubSnapshot& snapshot) const noexcept
+            {
+                std::array<std::uint8_t, 9> report;
+
+                for (;;)
+                {
+                    const auto before = sequence.load(std::memory_order_acquire);
+                    if (before & 1U) continue;
+
+                    for (std::size_t i = 0; i < report.size(); ++i)
+                        report[i] = data[i].load(std::memory_order_relaxed);
+                    const auto t = time.load(std::memory_order_relaxed);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (sequence.load(std::memory_order_relaxed) == before)
+                    {
+                        snapshot = HubSnapshot{report, std::chrono::steady_clock::time_point{std::chrono::steady_clock::duration{t}}};
+                        return before;
+                    }
+                }
+            }
+
+            [[nodiscard]] std::uint8_t load(std::size_t index) const noexcept
+            {
+                return data[index].load(std::memory_order_relaxed);
+            }
+
+        private:
+            std::atomic<std::uint32_t> sequence{0U};
+            std::array<std::atomic<std::uint8_t>, 9> data{};
+            std::atomic<std::chrono::steady_clock::rep> time{0};
+        };
+
+        class History final
+        {
+        public:
+            explicit History(const std::size_t c):
+                capacity{std::max(c, std::size_t{1U})}, entries{std::make_unique<ReportCell[]>(capacity)}
+            {}
+
+            void push(const HubSnapshot& snapshot) noexcept
+            {
+                const auto index = head.fetch_add(1U, std::memory_order_acq_rel);
+                entries[index % capacity].store(snapshot);
+            }
+
+            [[nodiscard]] auto getCapacity() const noexcept { return capacity; }
+
+            // copies up to count of the newest samples to snapshots, oldest first
+            std::size_t getLatest(HubSnapshot* snapshots, const std::size_t count) const noexcept
+            {
+                const auto end = head.load(std::memory_order_acquire);
+                const auto start = end - std::min({end, static_cast<std::uint64_t>(count), static_cast<std::uint64_t>(capacity)});
+
+                std::size_t copied = 0U;
+                for (auto index = start; index < end; ++index)
+                {
+                    const auto age = getAge(index, snapshots[copied]);
+                    if (age < 0) break; // not yet written
+                    if (age == 0) ++copied;
+                }
+                return copied;
+            }
+
+            // copies up to count of the samples taken at or after since to snapshots, oldest first
+            std::size_t getSince(const std::chrono::steady_clock::time_point since,
+                                 HubSnapshot* snapshots, const std::size_t count) const noexcept
+            {
+                const auto end = head.load(std::memory_order_acquire);
+                const auto start = end - std::min({end, static_cast<std::uint64_t>(count), static_cast<std::uint64_t>(capacity)});
+
+                std::size_t copied = 0U;
+                for (auto index = end; index > start; --index)
+                {
+                    auto& snapshot = snapshots[count - 1U - copied];
+                    const auto age = getAge(index - 1U, snapshot);
+                    if (age < 0) continue; // not yet written
+                    if (age > 0 || snapshot.getTime() < since) break;
+                    ++copied;
+                }
+
+                std::move(snapshots + count - copied, snapshots + count, snapshots);
+                return copied;
+            }
+
+        private:
+            // negative if the entry has not been written yet, positive if it has been overwritten
+            std::int32_t getAge(const std::uint64_t index, HubSnapshot& snapshot) const noexcept
+            {
+                const auto expected = static_cast<std::uint32_t>((index / capacity + 1U) * 2U);
+                return static_cast<std::int32_t>(entries[index % capacity].load(snapshot) - expected);
+            }
+
+            std::size_t capacity;
+            std::unique_ptr<ReportCell[]> entries;
+            std::atomic<std::uint64_t> head{0U};
+        };
+
+        struct Command final
+        {
+            std::uint8_t slot;
+            std::uint8_t value;
+        };
+
+        // bounded multi-producer queue, only one thread at a time may pop
+        template <class T, std::size_t capacity>
+        class MpscQueue final
+        {
+        public:
+            MpscQueue() noexcept
+            {
+                for (std::size_t i = 0; i < cells.size(); ++i)
+                    cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            bool push(const T& value) noexcept
+            {
+                auto position = enqueuePosition.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    auto& cell = cells[position % cells.size()];
+                    const auto difference = static_cast<std::ptrdiff_t>(cell.sequence.load(std::memory_order_acquire) - position);
+                    if (difference == 0)
+                    {
+                        if (enqueuePosition.compare_exchange_weak(position, position + 1U, std::memory_order_relaxed))
+                        {
+                            cell.value = value;
+                            cell.sequence.store(position + 1U);
+                            return true;
+                        }
+                    }
+                    else if (difference < 0)
+                        return false; // full
+                    else
+                        position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            bool pop(T& value) noexcept
+            {
+                const auto position = dequeuePosition.load(std::memory_order_relaxed);
+                auto& cell = cells[position % cells.size()];
+                if (cell.sequence.load() != position + 1U) return false;
+
+                value = cell.value;
+                cell.sequence.store(position + cells.size(), std::memory_order_release);
+                dequeuePosition.store(position + 1U, std::memory_order_relaxed);
+                return true;
+            }
+
+            [[nodiscard]] bool empty() const noexcept
+            {
+                const auto position = dequeuePosition.load(std::memory_order_relaxed);
+                return cells[position % cells.size()].sequence.load() != position + 1U;
+            }
+
+        private:
+            struct Cell final
+            {
+                std::atomic<std::size_t> sequence{0U};
+                T value{};
+            };
+
+            std::array<Cell, capacity> cells;
+            std::atomic<std::size_t> enqueuePosition{0U};
+            std::atomic<std::size_t> dequeuePosition{0U};
+        };
+
+#ifdef WEDOPP_STATS
+        class Stats final
+        {
+        public:
+            using TimePoint = std::chrono::steady_clock::time_point;
+
+            [[nodiscard]] static TimePoint start() noexcept
+            {
+                return std::chrono::steady_clock::now();
+            }
+
+            void read(const std::size_t bytes) noexcept
+            {
+                reads.fetch_add(1U, std::memory_order_relaxed);
+                bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+            }
+
+            void readFinished(const TimePoint startTime) noexcept
+            {
+                count(readLatency, startTime);
+            }
+
+            void write(const TimePoint startTime, const std::size_t bytes) noexcept
+            {
+                writes.fetch_add(1U, std::memory_order_relaxed);
+                bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+                count(writeLatency, startTime);
+            }
+
+            void skipWrite() noexcept
+            {
+                skippedWrites.fetch_add(1U, std::memory_order_relaxed);
+            }
+
+            void fail(const std::error_code& error) noexcept
+            {
+                (error == std::errc::timed_out ? timeouts : errors).fetch_add(1U, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] HubStats get() const noexcept
+            {
+                HubStats stats;
+                stats.reads = reads.load(std::memory_order_relaxed);
+                stats.writes = writes.load(std::memory_order_relaxed);
+                stats.bytesRead = bytesRead.load(std::memory_order_relaxed);
+                stats.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+                stats.errors = errors.load(std::memory_order_relaxed);
+                stats.timeouts = timeouts.load(std::memory_order_relaxed);
+                stats.skippedWrites = skippedWrites.load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < stats.readLatency.size(); ++i)
+                {
+                    stats.readLatency[i] = readLatency[i].load(std::memory_order_relaxed);
+                    stats.writeLatency[i] = writeLatency[i].load(std::memory_order_relaxed);
+                }
+                stats.time = std::chrono::steady_clock::now();
+                return stats;
+            }
+
+        private:
+            using Histogram = std::array<std::atomic<std::uint64_t>, std::tuple_size_v<decltype(HubStats::readLatency)>>;
+
+            static void count(Histogram& histogram, const TimePoint startTime) noexcept
+            {
+                auto microseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - startTime).count());
+
+                std::size_t bucket = 0U;
+                for (; microseconds != 0U && bucket < histogram.size() - 1U; microseconds >>= 1U)
+                    ++bucket;
+                histogram[bucket].fetch_add(1U, std::memory_order_relaxed);
+            }
+
+            std::atomic<std::uint64_t> reads{0U};
+            std::atomic<std::uint64_t> writes{0U};
+            std::atomic<std::uint64_t> bytesRead{0U};
+            std::atomic<std::uint64_t> bytesWritten{0U};
+            std::atomic<std::uint64_t> errors{0U};
+            std::atomic<std::uint64_t> timeouts{0U};
+            std::atomic<std::uint64_t> skippedWrites{0U};
+            Histogram readLatency{};
+            Histogram writeLatency{};
+        };
+#else
+        class Stats final
+        {
+        public:
+            struct TimePoint final {};
+
+            [[nodiscard]] static TimePoint start() noexcept { return {}; }
+            void read(std::size_t) noexcept {}
+            void readFinished(TimePoint) noexcept {}
+            void write(TimePoint, std::size_t) noexcept {}
+            void skipWrite() noexcept {}
+            void fail(const std::error_code&) noexcept {}
+
+            [[nodiscard]] HubStats get() const noexcept
+            {
+                HubStats stats;
+                stats.time = std::chrono::steady_clock::now();
+                return stats;
+            }
+        };
+#endif
+    }
+
+    // filters the values of a slot in the given order as reports arrive
+    class FilterChain final
+    {
+    public:
+        static constexpr std::size_t maxLength = 16U;
+
+        FilterChain& movingAverage(const std::size_t length)
+        {
+            return add(Kind::movingAverage, length);
+        }
+
+        FilterChain& median(const std::size_t length)
+        {
+            return add(Kind::median, length);
+        }
+
+        // a new value is passed on once it has been read count times in a row
+        FilterChain& debounce(const std::size_t count)
+        {
+            return add(Kind::debounce, count);
+        }
+
+        // the value is passed on once it differs from the last one passed on by more than threshold
+        FilterChain& deadband(const std::uint8_t threshold)
+        {
+            stages.push_back(Stage{Kind::deadband, threshold});
+            return *this;
+        }
+
+        [[nodiscard]] bool empty() const noexcept { return stages.empty(); }
+
+        std::uint8_t process(std::uint8_t value) noexcept
+        {
+            for (auto& stage : stages)
+                value = stage.process(value);
+            return value;
+        }
+
+        void reset() noexcept
+        {
+            for (auto& stage : stages)
+                stage.reset();
+        }
+
+    private:
+        enum class Kind: std::uint8_t
+        {
+            movingAverage,
+            median,
+            debounce,
+            deadband
+        };
+
+        struct Stage final
+        {
+            Stage(const Kind k, const std::size_t p) noexcept: kind{k}, parameter{p} {}
+
+            std::uint8_t process(const std::uint8_t value) noexcept
+            {
+                if (count == 0U)
+                {
+                    output = value;
+                    candidate = value;
+                }
+
+                switch (kind)
+                {
+                    case Kind::movingAverage:
+                    {
+                        if (count == parameter) sum -= window[next];
+                        else ++count;
+                        sum += value;
+                        window[next] = value;
+                        next = (next + 1U) % parameter;
+                        output = static_cast<std::uint8_t>((sum + count / 2U) / count);
+                        break;
+                    }
+                    case Kind::median:
+                    {
+                        if (count < parameter) ++count;
+                        window[next] = value;
+                        next = (next + 1U) % parameter;
+
+                        // a spike can only be outvoted by two other samples, so the first one is held until then
+                        if (count < std::min(parameter, std::size_t{3U})) break;
+
+                        const auto middle = (count - 1U) / 2U;
+                        std::array<std::uint8_t, maxLength> sorted;
+                        std::copy(window.begin(), window.begin() + count, sorted.begin());
+                        std::nth_element(sorted.begin(), sorted.begin() + middle, sorted.begin() + count);
+                        output = sorted[middle];
+                        break;
+                    }
+                    case Kind::debounce:
+                    {
+                        count = value == candidate ? count + 1U : 1U;
+                        candidate = value;
+                        if (count >= parameter) output = value;
+                        break;
+                    }
+                    case Kind::deadband:
+                    {
+                        count = 1U;
+                        if ((value > output ? value - output : output - value) > static_cast<int>(parameter))
+                            output = value;
+                        break;
+                    }
+                }
+
+                return output;
+            }
+
+            void reset() noexcept
+            {
+                count = 0U;
+                next = 0U;
+                sum = 0U;
+            }
+
+            Kind kind;
+            std::size_t parameter;
+            std::array<std::uint8_t, maxLength> window{};
+            std::size_t count = 0U;
+            std::size_t next = 0U;
+            std::size_t sum = 0U;
+            std::uint8_t output = 0U;
+            std::uint8_t candidate = 0U;
+        };
+
+        FilterChain& add(const Kind kind, const std::size_t length)
+        {
+            if (length == 0U || length > maxLength)
+                detail::raise(std::invalid_argument{"Filter length must be from 1 to 16"});
+
+            stages.push_back(Stage{kind, length});
+            return *this;
+        }
+
+        std::vector<Stage> stages;
+    };
+
+    // appends the reports read from and written to one hub to a memory-mapped file from its own thread,
+    // reports that do not fit into the queue are dropped
+    class Recorder final
+    {
+    public:
+        explicit Recorder(const std::string& filename):
+            queue{std::make_unique<Queue>()}
+        {
+            std::error_code error;
+            create(filename, error);
+            if (error)
+            {
+                finish();
+                detail::raise(std::system_error{error, "Failed to create recording"});
+            }
+        }
+
+        Recorder(const std::string& filename, std::error_code& error):
+            queue{std::make_unique<Queue>()}
+        {
+            create(filename, error);
+        }
+
+        ~Recorder()
+        {
+            running.store(false, std::memory_order_release);
+            {
+                std::lock_guard lock{parkMutex};
+                parked.store(false, std::memory_order_relaxed);
+            }
+            parkCondition.notify_one();
+            if (writer.joinable()) writer.join();
+            finish();
+        }
+
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
+
+        void record(const std::array<std::uint8_t, 9>& report,
+                    const std::chrono::steady_clock::time_point time,
+                    const RecordedReport::Direction direction) noexcept
+        {
+            RecordedReport recorded{};
+            recorded.time = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count());
+            recorded.report = report;
+            recorded.direction = direction;
+            if (!queue->push(recorded))
+            {
+                dropped.fetch_add(1U, std::memory_order_relaxed);
+                return;
+            }
+
+            // pairs with the fence in run, the writer is only woken when it parked on an empty queue
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_relaxed) && parked.exchange(false, std::memory_order_relaxed))
+            {
+                std::lock_guard lock{parkMutex};
+                parkCondition.notify_one();
+            }
+        }
+
+        [[nodiscard]] std::uint64_t getDroppedCount() const noexcept
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::error_code getError() const noexcept
+        {
+            return failed.load(std::memory_order_acquire) ? writerError : std::error_code{};
+        }
+
+    private:
+        using Queue = detail::MpscQueue<RecordedReport, 4096>;
+
+        static constexpr std::size_t initialCapacity = 1024U * 1024U;
+        static constexpr std::chrono::milliseconds batchInterval{1};
+
+        void create(const std::string& filename, std::error_code& status)
+        {
+            status.clear();
+#ifdef _WIN32
+            file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                status.assign(static_cast<int>(GetLastError()), std::system_category());
+                return;
+            }
+#else
+            fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd == -1)
+            {
+                status.assign(errno, std::system_category());
+                return;
+            }
+#endif
+            map(initialCapacity, status);
+            if (status) return;
+
+            start = std::chrono::steady_clock::now();
+            running.store(true, std::memory_order_release);
+            writer = std::thread{&Recorder::run, this};
+        }
+
+        // the file is grown only from the writer thread, so reports are recorded without system calls
+        void map(const std::size_t newCapacity, std::error_code& status) noexcept
+        {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            data = nullptr;
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(static_cast<std::uint64_t>(newCapacity) >> 32U),
+                static_cast<DWORD>(newCapacity & 0xFFFFFFFFU), nullptr);
+            if (!mapping)
+            {
+                status.assign(static_cast<int>(GetLastError()), std::system_category());
+                return;
+            }
+
+            data = static_cast<std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, newCapacity));
+            if (!data)
+            {
+                status.assign(static_cast<int>(GetLastError()), std::system_category());
+                return;
+            }
+#else
+            if (data) munmap(data, capacity);
+            data = nullptr;
+
+            if (ftruncate(fd, static_cast<off_t>(newCapacity)) == -1)
+            {
+                status.assign(errno, std::system_category());
+                return;
+            }
+
+            const auto address = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED)
+            {
+                status.assign(errno, std::system_category());
+                return;
+            }
+            data = static_cast<std::uint8_t*>(address);
+#endif
+            capacity = newCapacity;
+        }
+
+        void finish() noexcept
+        {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                LARGE_INTEGER position;
+                position.QuadPart = static_cast<LONGLONG>(size);
+                if (SetFilePointerEx(file, position, nullptr, FILE_BEGIN)) SetEndOfFile(file);
+                CloseHandle(file);
+            }
+#else
+            if (data) munmap(data, capacity);
+            if (fd != -1)
+            {
+                static_cast<void>(ftruncate(fd, static_cast<off_t>(size)));
+                close(fd);
+            }
+#endif
+        }
+
+        void run() noexcept
+        {
+            for (bool idle = false;;)
+            {
+                RecordedReport recorded;
+                if (!queue->pop(recorded))
+                {
+                    // reports of a busy hub are written in batches, the writer parks when no report came for a batch
+                    if (!idle)
+                    {
+                        idle = true;
+                        std::this_thread::sleep_for(batchInterval);
+                        continue;
+                    }
+
+                    std::unique_lock lock{parkMutex};
+                    if (!running.load(std::memory_order_acquire)) return;
+
+                    parked.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (queue->empty())
+                        parkCondition.wait(lock, [this]() noexcept { return !parked.load(std::memory_order_relaxed); });
+                    parked.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                idle = false;
+
+                if (failed.load(std::memory_order_relaxed)) continue;
+
+                if (size + sizeof(recorded) > capacity)
+                    if (map(capacity * 2U, writerError); writerError)
+                    {
+                        failed.store(true, std::memory_order_release);
+                        continue;
+                    }
+
+                std::memcpy(data + size, &recorded, sizeof(recorded));
+                size += sizeof(recorded);
+            }
+        }
+
+        std::unique_ptr<Queue> queue;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int fd = -1;
+#endif
+        std::uint8_t* data = nullptr;
+        std::size_t capacity = 0U;
+        std::size_t size = 0U;
+        std::chrono::steady_clock::time_point start;
+        std::thread writer;
+        std::atomic<bool> running{false};
+        std::mutex parkMutex;
+        std::condition_variable parkCondition;
+        std::atomic<bool> parked{false};
+        std::atomic<bool> failed{false};
+        std::error_code writerError;
+        std::atomic<std::uint64_t> dropped{0U};
+    };
+
+    namespace detail
+    {
+        // a report that the transport writes in the background, between Processor::startWrite and finishWrite
+        struct PendingWrite final
+        {
+            std::array<std::uint8_t, 9> report{};
+            std::uint64_t sequence = 0U;
+            Stats::TimePoint startTime{};
+        };
+
+#ifdef WEDOPP_COROUTINES
+        // lives in the frame of the awaiting coroutine, which is resumed from the thread that reads the hub
+        struct Waiter final
+        {
+            static constexpr std::uint8_t anySlot = 0xFFU;
+
+            Waiter* next = nullptr;
+            std::uint8_t slot = anySlot; // waits for any report or for the value of the slot to differ from value
+            std::uint8_t value = 0U;
+            HubSnapshot snapshot;
+            std::error_code error;
+            std::coroutine_handle<> handle;
+        };
+
+        // lives in the frame of the coroutine awaiting a write, which is resumed from the event loop
+        struct WriteOperation final
+        {
+            WriteOperation* next = nullptr;
+            PendingWrite write;
+            std::error_code error;
+            std::coroutine_handle<> handle;
+        };
+#endif
+
+        WEDOPP_INLINE std::optional<File> reopenHub(const std::string& path, std::error_code& error);
+
+        template <class Transport>
+        class Processor final
+        {
+        public:
+            explicit Processor(Transport t) noexcept: transport{std::move(t)} {}
+
+            // the write path allocates nothing, so it throws only if the transport does
+            static constexpr bool nothrowWrite = noexcept(std::declval<Transport&>().write(
+                std::declval<const std::uint8_t*>(), std::size_t{}, std::chrono::milliseconds{}, std::declval<std::error_code&>()));
+
+            ~Processor()
+            {
+                stop();
+            }
+
+            Processor(const Processor&) = delete;
+            Processor& operator=(const Processor&) = delete;
+
+            void start()
+            {
+                if (running.load(std::memory_order_acquire)) return;
+                if (reader.joinable()) reader.join();
+
+                readerError.clear();
+                failed.store(false, std::memory_order_relaxed);
+                running.store(true, std::memory_order_release);
+                reader = std::thread{&Processor::run, this};
+            }
+
+            void stop()
+            {
+                running.store(false, std::memory_order_release);
+                if (reader.joinable()) reader.join();
+#ifdef WEDOPP_COROUTINES
+                if (!isDriven()) resumeWaiters(nullptr, std::make_error_code(std::errc::operation_canceled));
+#endif
+            }
+
+            [[nodiscard]] bool isReading() const noexcept
+            {
+                return running.load(std::memory_order_acquire);
+            }
+
+            void attach() noexcept
+            {
+                attached.store(true, std::memory_order_release);
+            }
+
+            void detach() noexcept
+            {
+                attached.store(false, std::memory_order_release);
+#ifdef WEDOPP_COROUTINES
+                {
+                    std::lock_guard lock{waiterMutex};
+                    writer = nullptr;
+                }
+                if (!isDriven()) resumeWaiters(nullptr, std::make_error_code(std::errc::operation_canceled));
+#endif
+            }
+
+#ifdef WEDOPP_COROUTINES
+            // set by the event loop that reads the hub, it returns false if the write finished without suspending
+            void setWriter(std::function<bool(WriteOperation&)> w)
+            {
+                std::lock_guard lock{waiterMutex};
+                writer = std::move(w);
+            }
+
+            // queues the value like writeValue and hands the write to the event loop, returns false if the awaiting
+            // coroutine is not suspended, because the write has finished, or waits for the commit of an update block
+            bool writeAsync(const std::uint8_t slot, const std::uint8_t value, WriteOperation& operation)
+            {
+                std::lock_guard lock{waiterMutex};
+                if (!writer)
+                {
+                    operation.error = std::make_error_code(std::errc::operation_not_permitted);
+                    return false;
+                }
+
+                touch();
+                push(slot, value, operation.error);
+                if (operation.error || updateDepth.load() > 0U) return false;
+                return writer(operation);
+            }
+#endif
+
+            [[nodiscard]] bool isDriven() const noexcept
+            {
+                return isReading() || attached.load(std::memory_order_acquire);
+            }
+
+            [[nodiscard]] const auto& getTransport() const noexcept { return transport; }
+
+            HubSnapshot publish(const std::array<std::uint8_t, 9>& report)
+            {
+                const auto time = std::chrono::steady_clock::now();
+                stats.read(report.size());
+                record(report, time, RecordedReport::Direction::input);
+
+                const auto typeChanged = updateType(report, 0U) | updateType(report, 1U);
+                const HubSnapshot snapshot{filtering ? filter(report, typeChanged) : report, time};
+                latest.store(snapshot);
+                if (const auto h = history.load(std::memory_order_acquire)) h->push(snapshot);
+                received.store(true, std::memory_order_release);
+
+                if (subscribed.load(std::memory_order_acquire)) notify(snapshot.getReport(), typeChanged);
+#ifdef WEDOPP_COROUTINES
+                // pairs with the fence in wait, so that either the waiter sees this report or it is resumed here
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiting.load(std::memory_order_relaxed)) resumeWaiters(&snapshot, std::error_code{});
+#endif
+                return snapshot;
+            }
+
+            void enableHistory(const std::size_t capacity)
+            {
+                if (historyStorage)
+                    detail::raise(std::logic_error{"History already enabled"});
+
+                historyStorage = std::make_unique<History>(capacity);
+                history.store(historyStorage.get(), std::memory_order_release);
+            }
+
+            [[nodiscard]] const History* getHistory() const noexcept
+            {
+                return history.load(std::memory_order_acquire);
+            }
+
+            using Opener = std::function<std::optional<Transport>(std::error_code&)>;
+
+            void setOpener(Opener o)
+            {
+                if (isReading())
+                    detail::raise(std::logic_error{"The opener cannot be changed while the hub is being read"});
+                opener = std::move(o);
+            }
+
+            // HID hubs without an opener are reopened by the path of their hub
+            void setPath(const std::string& p) noexcept
+            {
+                path = &p;
+            }
+
+            // a zero interval makes the reader thread stop when reading fails instead of reopening the transport
+            void setReconnectInterval(const std::chrono::milliseconds interval)
+            {
+                if (isReading())
+                    detail::raise(std::logic_error{"Reconnecting cannot be changed while the hub is being read"});
+                reconnectInterval = interval;
+            }
+
+            [[nodiscard]] bool isConnected() const noexcept
+            {
+                return connected.load(std::memory_order_acquire);
+            }
+
+            // replaces the transport with a newly opened one, while writes are held off
+            bool reopen(std::error_code& error)
+            {
+                error.clear();
+                auto opened = open(error);
+                if (!opened)
+                {
+                    if (!error) error = std::make_error_code(std::errc::no_such_device);
+                    return false;
+                }
+
+                while (flushing.exchange(true))
+                    std::this_thread::yield();
+                transport = std::move(*opened);
+                written = false;
+                flushing.store(false);
+
+                connected.store(true, std::memory_order_release);
+                return true;
+            }
+
+            // filters run on the thread that reads the hub, so they can only be changed while nothing does
+            void setFilter(const std::uint8_t slot, FilterChain chain)
+            {
+                if (isDriven())
+                    detail::raise(std::logic_error{"Filters cannot be changed while the hub is being read"});
+
+                filters[slot] = chain.empty() ? nullptr : std::make_unique<FilterChain>(std::move(chain));
+                filtering = filters[0] || filters[1];
+            }
+
+            void setRecorder(Recorder* r) noexcept
+            {
+                recorder.store(r);
+                // the previous recorder may still be in use by a thread that loaded it before the store
+                while (recording.load() != 0U)
+                    std::this_thread::yield();
+            }
+
+            std::size_t subscribe(const std::uint8_t slot, const std::uint8_t threshold, std::function<void(std::uint8_t)> callback)
+            {
+                std::lock_guard lock{subscriptionMutex};
+                subscriptions.push_back(Subscription{
+                    ++lastSubscriptionId,
+                    slot,
+                    threshold,
+                    getValue(slot),
+                    std::make_shared<const std::function<void(std::uint8_t)>>(std::move(callback))
+                });
+                subscribed.store(true, std::memory_order_release);
+                return lastSubscriptionId;
+            }
+
+            std::size_t subscribeType(const std::uint8_t slot, std::function<void(DeviceType)> callback)
+            {
+                std::lock_guard lock{subscriptionMutex};
+                typeSubscriptions.push_back(TypeSubscription{
+                    ++lastSubscriptionId,
+                    slot,
+                    std::make_shared<const std::function<void(DeviceType)>>(std::move(callback))
+                });
+                subscribed.store(true, std::memory_order_release);
+                return lastSubscriptionId;
+            }
+
+#ifdef WEDOPP_COROUTINES
+            // returns false if the waiter is ready without suspending, with its snapshot or error set
+            bool wait(Waiter& waiter)
+            {
+                std::lock_guard lock{waiterMutex};
+                if (!isDriven())
+                {
+                    waiter.error = std::make_error_code(std::errc::operation_not_permitted);
+                    return false;
+                }
+
+                if (failed.load(std::memory_order_acquire))
+                {
+                    waiter.error = readerError;
+                    return false;
+                }
+
+                waiter.next = waiters;
+                waiters = &waiter;
+                waiting.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (waiter.slot != Waiter::anySlot)
+                    if (const auto snapshot = latest.load(); snapshot.getValue(waiter.slot) != waiter.value)
+                    {
+                        waiters = waiter.next;
+                        waiter.snapshot = snapshot;
+                        return false;
+                    }
+
+                return true;
+            }
+
+#endif
+            void unsubscribe(const std::size_t id)
+            {
+                std::lock_guard lock{subscriptionMutex};
+                subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(),
+                    [id](const auto& subscription) noexcept { return subscription.id == id; }), subscriptions.end());
+                typeSubscriptions.erase(std::remove_if(typeSubscriptions.begin(), typeSubscriptions.end(),
+                    [id](const auto& subscription) noexcept { return subscription.id == id; }), typeSubscriptions.end());
+                subscribed.store(!subscriptions.empty() || !typeSubscriptions.empty(), std::memory_order_release);
+            }
+
+            HubSnapshot update()
+            {
+                std::error_code error;
+                const auto snapshot = update(error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+                return snapshot;
+            }
+
+            HubSnapshot update(std::error_code& error)
+            {
+                return update(infinite, error);
+            }
+
+            HubSnapshot update(const std::chrono::milliseconds timeout, std::error_code& error)
+            {
+                const auto snapshot = receive(timeout, error);
+                if (error) stats.fail(error);
+                return snapshot;
+            }
+
+#ifndef _WIN32
+            bool tryUpdate(HubSnapshot& snapshot, std::error_code& error)
+            {
+                std::array<std::uint8_t, 9> report;
+                if (!transport.tryRead(report, error))
+                {
+                    if (error) stats.fail(error);
+                    return false;
+                }
+                snapshot = publish(report);
+                return true;
+            }
+#endif
+
+            HubSnapshot poll()
+            {
+                std::error_code error;
+                const auto snapshot = poll(error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+                return snapshot;
+            }
+
+            HubSnapshot poll(std::error_code& error)
+            {
+                if (!isDriven()) return update(error);
+
+                checkReader(error);
+                return latest.load();
+            }
+
+            DeviceType readType(const std::uint8_t slot)
+            {
+                std::error_code error;
+                const auto type = readType(slot, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+                return type;
+            }
+
+            DeviceType readType(const std::uint8_t slot, std::error_code& error)
+            {
+                if (received.load(std::memory_order_acquire))
+                    checkReader(error);
+                else
+                    refresh(error);
+                return getType(slot);
+            }
+
+            std::uint8_t readValue(const std::uint8_t slot)
+            {
+                std::error_code error;
+                const auto value = readValue(slot, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to read from file"});
+                return value;
+            }
+
+            std::uint8_t readValue(const std::uint8_t slot, std::error_code& error)
+            {
+                refresh(error);
+                return getValue(slot);
+            }
+
+            std::size_t readReport(std::uint8_t* data, const std::size_t size, std::error_code& error)
+            {
+                if (size < reportSize)
+                {
+                    error = std::make_error_code(std::errc::invalid_argument);
+                    return 0U;
+                }
+
+                if (isDriven())
+                {
+                    checkReader(error);
+                    if (error) return 0U;
+
+                    const auto snapshot = latest.load();
+                    const auto& report = snapshot.getReport();
+                    std::copy(report.begin(), report.end(), data);
+                    return reportSize;
+                }
+
+                const auto startTime = stats.start();
+                transport.read(data, reportSize, infinite, error);
+                if (error)
+                {
+                    stats.fail(error);
+                    return 0U;
+                }
+                stats.readFinished(startTime);
+
+                std::array<std::uint8_t, 9> report;
+                std::copy_n(data, reportSize, report.begin());
+                publish(report);
+                return reportSize;
+            }
+
+            void writeReport(const std::uint8_t* data, const std::size_t size, std::error_code& error) noexcept(nothrowWrite)
+            {
+                if (size != reportSize)
+                {
+                    error = std::make_error_code(std::errc::invalid_argument);
+                    return;
+                }
+
+                touch();
+                while (flushing.exchange(true))
+                    std::this_thread::yield();
+
+                // later single-slot writes start from this report
+                std::copy_n(data, reportSize, writeBuffer.begin());
+                outputs[0].store(data[2], std::memory_order_relaxed);
+                outputs[1].store(data[3], std::memory_order_relaxed);
+
+                const auto startTime = stats.start();
+                transport.write(data, size, infinite, error);
+                if (error)
+                    stats.fail(error);
+                else
+                {
+                    stats.write(startTime, size);
+                    markSent(writeBuffer, ++sequence);
+                }
+                flushing.store(false);
+
+                if (!error && !commands.empty()) drain(error);
+            }
+
+            [[nodiscard]] DeviceType getType(std::uint8_t slot) const noexcept
+            {
+                return types[slot].load(std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] std::uint8_t getValue(std::uint8_t slot) const noexcept
+            {
+                return latest.load(3U + slot * 2U);
+            }
+
+            // the value last set, which may not have been written yet
+            [[nodiscard]] std::uint8_t getOutput(std::uint8_t slot) const noexcept
+            {
+                return outputs[slot].load(std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] auto getSnapshot() const noexcept { return latest.load(); }
+            [[nodiscard]] auto getStats() const noexcept { return stats.get(); }
+
+            void writeValue(const std::uint8_t slot, const std::uint8_t value)
+            {
+                std::error_code error;
+                writeValue(slot, value, error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
+            }
+
+            // may be called from any thread, the write is done by whichever thread is draining the queue
+            void writeValue(const std::uint8_t slot, const std::uint8_t value, std::error_code& error) noexcept(nothrowWrite)
+            {
+                touch();
+                enqueue(slot, value, error);
+            }
+
+            // the time of the last value or report written by the user, or zero if there was none
+            [[nodiscard]] std::chrono::steady_clock::rep getLastCommandTime() const noexcept
+            {
+                return lastCommand.load(std::memory_order_relaxed);
+            }
+
+            // writes both outputs as zero without counting as a command, also while an update block is open
+            void stopOutputs(std::error_code& error) noexcept(nothrowWrite)
+            {
+                error.clear();
+                while (flushing.exchange(true))
+                    std::this_thread::yield();
 
-            void writeValue(std::uint8_t slot, std::uint8_t value)
-            {
                 writeBuffer[1U] = 64U;
-                writeBuffer[2U + slot] = value;
-                file.write(writeBuffer);
+                writeBuffer[2U] = 0U;
+                writeBuffer[3U] = 0U;
+                outputs[0].store(0U, std::memory_order_relaxed);
+                outputs[1].store(0U, std::memory_order_relaxed);
+                flush(error);
+                flushing.store(false);
+            }
+
+            void beginUpdate() noexcept
+            {
+                ++updateDepth;
+            }
+
+            void commit()
+            {
+                std::error_code error;
+                commit(error);
+                if (error)
+                    detail::raise(std::system_error{error, "Failed to write to file"});
+            }
+
+            void commit(std::error_code& error) noexcept(nothrowWrite)
+            {
+                error.clear();
+                if (endUpdate()) drain(error);
+            }
+
+            // closes an update block without writing, returns true if it was the outermost one
+            bool endUpdate() noexcept
+            {
+                // the queued commands may be written only now, so the watchdog counts from here
+                touch();
+                auto depth = updateDepth.load();
+                while (depth > 0U && !updateDepth.compare_exchange_weak(depth, depth - 1U));
+                return depth == 1U;
+            }
+
+            // writes the queued commands without waiting for the transport, returns false if it can not take the report yet
+            // or another thread is writing, so that the call is repeated once the transport can be written
+            bool tryFlush(std::error_code& error) noexcept
+            {
+                error.clear();
+                do
+                {
+                    if (flushing.exchange(true)) return false;
+
+                    takeCommands();
+                    if (updateDepth.load() == 0U && !tryWriteBuffer(error))
+                    {
+                        flushing.store(false);
+                        return static_cast<bool>(error);
+                    }
+                    flushing.store(false);
+                }
+                // a command pushed while the flag was held would otherwise be left in the queue
+                while (!commands.empty());
+
+                return true;
+            }
+
+            // takes the queued commands into the report of write and calls start with it, which must start
+            // a write that is finished with finishWrite without waiting for it, returns false if nothing was started
+            template <class Start>
+            bool startWrite(PendingWrite& write, Start start, std::error_code& error)
+            {
+                error.clear();
+                while (flushing.exchange(true))
+                    std::this_thread::yield();
+
+                takeCommands();
+                const auto sent = isSent();
+                if (sent)
+                    stats.skipWrite();
+                else
+                {
+                    // the write is started under the flag, so that it is ordered with the other writes
+                    write.report = writeBuffer;
+                    write.sequence = ++sequence;
+                    write.startTime = stats.start();
+                    start(write.report, error);
+                    if (error)
+                        stats.fail(error);
+                    else
+                        ++pendingWrites;
+                }
+                flushing.store(false);
+
+                return !sent && !error;
+            }
+
+            void finishWrite(const PendingWrite& write, std::error_code& error) noexcept(nothrowWrite)
+            {
+                while (flushing.exchange(true))
+                    std::this_thread::yield();
+
+                --pendingWrites;
+                if (error)
+                    stats.fail(error);
+                else
+                {
+                    stats.write(write.startTime, write.report.size());
+                    markSent(write.report, write.sequence);
+                }
+                flushing.store(false);
+
+                if (!error && !commands.empty()) drain(error);
+            }
+
+        private:
+            std::optional<Transport> open(std::error_code& error)
+            {
+                if (opener) return opener(error);
+
+                if constexpr (std::is_same_v<Transport, File>)
+                    if (path) return detail::reopenHub(*path, error);
+
+                error = std::make_error_code(std::errc::operation_not_supported);
+                return std::nullopt;
+            }
+
+            void touch() noexcept
+            {
+                lastCommand.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            void enqueue(const std::uint8_t slot, const std::uint8_t value, std::error_code& error) noexcept(nothrowWrite)
+            {
+                push(slot, value, error);
+                if (!error && updateDepth.load() == 0U) drain(error);
+            }
+
+            void push(const std::uint8_t slot, const std::uint8_t value, std::error_code& error) noexcept(nothrowWrite)
+            {
+                error.clear();
+                outputs[slot].store(value, std::memory_order_relaxed);
+                while (!commands.push(Command{slot, value}))
+                {
+                    drain(error);
+                    if (error) return;
+                    std::this_thread::yield();
+                }
+            }
+
+            void drain(std::error_code& error) noexcept(nothrowWrite)
+            {
+                error.clear();
+                do
+                {
+                    if (flushing.exchange(true)) return;
+
+                    takeCommands();
+                    if (updateDepth.load() == 0U) flush(error);
+                    flushing.store(false);
+                }
+                // a command pushed while the flag was held would otherwise be left in the queue
+                while (!error && !commands.empty());
+            }
+
+            void flush(std::error_code& error) noexcept(nothrowWrite)
+            {
+                if (isSent())
+                {
+                    stats.skipWrite();
+                    return;
+                }
+
+                const auto startTime = stats.start();
+                transport.write(writeBuffer.data(), writeBuffer.size(), infinite, error);
+                if (error)
+                {
+                    stats.fail(error);
+                    return;
+                }
+                stats.write(startTime, writeBuffer.size());
+                markSent(writeBuffer, ++sequence);
+            }
+
+            bool tryWriteBuffer(std::error_code& error) noexcept
+            {
+                if (isSent())
+                {
+                    stats.skipWrite();
+                    return true;
+                }
+
+                const auto startTime = stats.start();
+                if (!transport.tryWrite(writeBuffer, error))
+                {
+                    if (error) stats.fail(error);
+                    return false;
+                }
+                stats.write(startTime, writeBuffer.size());
+                markSent(writeBuffer, ++sequence);
+                return true;
+            }
+
+            // a report still in flight may differ from the one last sent
+            [[nodiscard]] bool isSent() const noexcept
+            {
+                return written && pendingWrites == 0U && writeBuffer == sentBuffer;
+            }
+
+            // writes reach the device in the order they are started, so a report that finishes after a newer one is not the last sent
+            void markSent(const std::array<std::uint8_t, 9>& report, const std::uint64_t reportSequence) noexcept
+            {
+                if (reportSequence > sentSequence)
+                {
+                    sentBuffer = report;
+                    sentSequence = reportSequence;
+                    written = true;
+                }
+                record(report, std::chrono::steady_clock::now(), RecordedReport::Direction::output);
+            }
+
+            void takeCommands() noexcept
+            {
+                Command command;
+                while (commands.pop(command))
+                {
+                    writeBuffer[1U] = 64U;
+                    writeBuffer[2U + command.slot] = command.value;
+                }
+            }
+
+            HubSnapshot receive(const std::chrono::milliseconds timeout, std::error_code& error)
+            {
+                std::array<std::uint8_t, 9> report;
+                const auto startTime = stats.start();
+                transport.read(report.data(), report.size(), timeout, error);
+                if (error) return latest.load();
+
+                stats.readFinished(startTime);
+                return publish(report);
+            }
+
+            void run() noexcept
+            {
+                // reads time out so that stopping does not depend on the transport delivering another report
+                constexpr std::chrono::milliseconds stopCheckInterval{100};
+
+                while (running.load(std::memory_order_acquire))
+                {
+                    if (receive(stopCheckInterval, readerError); readerError == std::errc::timed_out)
+                        continue;
+
+                    if (readerError)
+                    {
+                        stats.fail(readerError);
+                        if (reconnectInterval > std::chrono::milliseconds::zero())
+                        {
+                            if (!waitForReconnect(stopCheckInterval)) break;
+                            // nothing else reads the error unless failed is set
+                            readerError.clear();
+                            continue;
+                        }
+
+                        failed.store(true, std::memory_order_release);
+#ifdef WEDOPP_COROUTINES
+                        resumeWaiters(nullptr, readerError);
+#endif
+                        break;
+                    }
+                }
+            }
+
+            // returns false if reading was stopped before the transport could be reopened
+            bool waitForReconnect(const std::chrono::milliseconds stopCheckInterval) noexcept
+            {
+                connected.store(false, std::memory_order_release);
+
+                while (running.load(std::memory_order_acquire))
+                {
+                    std::error_code error;
+                    if (reopen(error)) return true;
+
+                    for (auto waited = std::chrono::milliseconds::zero();
+                         waited < reconnectInterval && running.load(std::memory_order_acquire);
+                         waited += stopCheckInterval)
+                        std::this_thread::sleep_for(std::min(stopCheckInterval, reconnectInterval - waited));
+                }
+
+                return false;
+            }
+
+            struct Subscription final
+            {
+                std::size_t id;
+                std::uint8_t slot;
+                std::uint8_t threshold;
+                std::uint8_t value;
+                std::shared_ptr<const std::function<void(std::uint8_t)>> callback;
+            };
+
+            struct TypeSubscription final
+            {
+                std::size_t id;
+                std::uint8_t slot;
+                std::shared_ptr<const std::function<void(DeviceType)>> callback;
+            };
+
+            void record(const std::array<std::uint8_t, 9>& report,
+                        const std::chrono::steady_clock::time_point time,
+                        const RecordedReport::Direction direction) noexcept
+            {
+                if (!recorder.load(std::memory_order_relaxed)) return;
+
+                ++recording;
+                if (const auto r = recorder.load()) r->record(report, time, direction);
+                --recording;
+            }
+
+            // a chain starts over when the device in its slot changes
+            std::array<std::uint8_t, 9> filter(std::array<std::uint8_t, 9> report, const unsigned typeChanged) noexcept
+            {
+                for (std::uint8_t slot = 0U; slot < 2U; ++slot)
+                    if (const auto& chain = filters[slot])
+                    {
+                        if (typeChanged & (1U << slot)) chain->reset();
+                        report[3U + slot * 2U] = chain->process(report[3U + slot * 2U]);
+                    }
+                return report;
+            }
+
+            // returns a bit for the slot if the decoded type has changed
+            unsigned updateType(const std::array<std::uint8_t, 9>& report, const std::uint8_t slot) noexcept
+            {
+                const std::uint16_t raw = report[4U + slot * 2U];
+                if (rawTypes[slot].exchange(raw, std::memory_order_relaxed) == raw) return 0U;
+
+                const auto type = getDeviceType(static_cast<std::uint8_t>(raw));
+                return types[slot].exchange(type, std::memory_order_relaxed) != type ? 1U << slot : 0U;
+            }
+
+            void notify(const std::array<std::uint8_t, 9>& report, const unsigned typeChanged)
+            {
+                std::vector<std::pair<std::shared_ptr<const std::function<void(DeviceType)>>, DeviceType>> typeChanges;
+                std::vector<std::pair<std::shared_ptr<const std::function<void(std::uint8_t)>>, std::uint8_t>> changes;
+                {
+                    std::lock_guard lock{subscriptionMutex};
+                    if (typeChanged)
+                        for (const auto& subscription : typeSubscriptions)
+                            if (typeChanged & (1U << subscription.slot))
+                                typeChanges.emplace_back(subscription.callback, getType(subscription.slot));
+
+                    for (auto& subscription : subscriptions)
+                    {
+                        const auto value = report[3U + subscription.slot * 2U];
+                        const auto delta = value > subscription.value ? value - subscription.value : subscription.value - value;
+                        if (delta > subscription.threshold)
+                        {
+                            subscription.value = value;
+                            changes.emplace_back(subscription.callback, value);
+                        }
+                    }
+                }
+
+                for (const auto& [callback, type] : typeChanges)
+                    (*callback)(type);
+
+                for (const auto& [callback, value] : changes)
+                    (*callback)(value);
+            }
+
+#ifdef WEDOPP_COROUTINES
+            // resumes the waiters whose condition the snapshot meets, or all of them with the error
+            void resumeWaiters(const HubSnapshot* snapshot, const std::error_code& error)
+            {
+                Waiter* ready = nullptr;
+                {
+                    std::lock_guard lock{waiterMutex};
+                    for (auto link = &waiters; *link;)
+                        if (auto& waiter = **link; !snapshot || waiter.slot == Waiter::anySlot ||
+                            snapshot->getValue(waiter.slot) != waiter.value)
+                        {
+                            *link = waiter.next;
+                            waiter.next = ready;
+                            ready = &waiter;
+                        }
+                        else
+                            link = &waiter.next;
+
+                    waiting.store(waiters != nullptr, std::memory_order_relaxed);
+                }
+
+                // a resumed coroutine may wait again or finish and free its waiter
+                while (ready)
+                {
+                    auto& waiter = *ready;
+                    ready = waiter.next;
+                    if (snapshot) waiter.snapshot = *snapshot;
+                    waiter.error = error;
+                    waiter.handle.resume();
+                }
+            }
+
+#endif
+            void refresh(std::error_code& error)
+            {
+                if (isDriven())
+                    checkReader(error);
+                else
+                    update(error);
+            }
+
+            void checkReader(std::error_code& error) const noexcept
+            {
+                error = failed.load(std::memory_order_acquire) ? readerError : std::error_code{};
+            }
+
+            Transport transport;
+            Stats stats;
+            std::atomic<Recorder*> recorder{nullptr};
+            std::atomic<std::size_t> recording{0U};
+            ReportCell latest;
+            std::unique_ptr<History> historyStorage;
+            std::atomic<History*> history{nullptr};
+            std::atomic<bool> received{false};
+            std::array<std::atomic<std::uint16_t>, 2> rawTypes{0x100U, 0x100U};
+            std::array<std::atomic<DeviceType>, 2> types{DeviceType::none, DeviceType::none};
+            std::array<std::atomic<std::uint8_t>, 2> outputs{0U, 0U};
+            std::atomic<std::chrono::steady_clock::rep> lastCommand{0};
+            Opener opener;
+            const std::string* path = nullptr;
+            std::chrono::milliseconds reconnectInterval{0};
+            std::atomic<bool> connected{true};
+            std::array<std::uint8_t, 9> writeBuffer{};
+            std::array<std::uint8_t, 9> sentBuffer{};
+            bool written = false;
+            std::uint64_t sequence = 0U;
+            std::uint64_t sentSequence = 0U;
+            std::size_t pendingWrites = 0U;
+            MpscQueue<Command, 32> commands;
+            std::atomic<std::size_t> updateDepth{0U};
+            std::atomic<bool> flushing{false};
+            std::thread reader;
+            std::atomic<bool> running{false};
+            std::atomic<bool> failed{false};
+            std::atomic<bool> attached{false};
+            std::error_code readerError;
+            std::mutex subscriptionMutex;
+            std::vector<Subscription> subscriptions;
+            std::vector<TypeSubscription> typeSubscriptions;
+            std::size_t lastSubscriptionId = 0U;
+            std::atomic<bool> subscribed{false};
+            std::array<std::unique_ptr<FilterChain>, 2> filters;
+            bool filtering = false;
+#ifdef WEDOPP_COROUTINES
+            std::mutex waiterMutex;
+            Waiter* waiters = nullptr;
+            std::atomic<bool> waiting{false};
+            std::function<bool(WriteOperation&)> writer;
+#endif
+        };
+
+#ifdef WEDOPP_COROUTINES
+        template <class Transport>
+        class ReportAwaitable final
+        {
+        public:
+            ReportAwaitable(Processor<Transport>& p, std::error_code* e,
+                            const std::uint8_t slot = Waiter::anySlot, const std::uint8_t value = 0U) noexcept:
+                processor{&p}, errorOutput{e}
+            {
+                waiter.slot = slot;
+                waiter.value = value;
+            }
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(const std::coroutine_handle<> handle)
+            {
+                waiter.handle = handle;
+                return processor->wait(waiter);
+            }
+
+            HubSnapshot await_resume() const
+            {
+                if (errorOutput)
+                    *errorOutput = waiter.error;
+                else if (waiter.error)
+                    detail::raise(std::system_error{waiter.error, "Failed to wait for report"});
+                return waiter.snapshot;
+            }
+
+        private:
+            Processor<Transport>* processor;
+            std::error_code* errorOutput;
+            Waiter waiter;
+        };
+
+        template <class Transport>
+        class ValueAwaitable final
+        {
+        public:
+            ValueAwaitable(Processor<Transport>& p, std::error_code* e, const std::uint8_t s) noexcept:
+                report{p, e, s, p.getValue(s)}, slot{s}
+            {}
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+            bool await_suspend(const std::coroutine_handle<> handle) { return report.await_suspend(handle); }
+            std::uint8_t await_resume() const { return report.await_resume().getValue(slot); }
+
+        private:
+            ReportAwaitable<Transport> report;
+            std::uint8_t slot;
+        };
+
+        // the write is done by the event loop that reads the hub, with epoll on Linux and the completion port on Windows,
+        // and the coroutine is resumed from the loop once the device has taken the report
+        class WriteAwaitable final
+        {
+        public:
+            WriteAwaitable(Processor<File>& p, std::error_code* e, const std::uint8_t s, const std::uint8_t v) noexcept:
+                processor{&p}, errorOutput{e}, slot{s}, value{v}
+            {}
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(const std::coroutine_handle<> handle)
+            {
+                operation.handle = handle;
+                return processor->writeAsync(slot, value, operation);
+            }
+
+            void await_resume() const
+            {
+                if (errorOutput)
+                    *errorOutput = operation.error;
+                else if (operation.error)
+                    detail::raise(std::system_error{operation.error, "Failed to write value"});
+            }
+
+        private:
+            Processor<File>* processor;
+            std::error_code* errorOutput;
+            std::uint8_t slot;
+            std::uint8_t value;
+            WriteOperation operation;
+        };
+#endif
+    }
+
+    template <class Transport>
+    class BasicOutputScheduler;
+
+    template <class Transport>
+    class BasicDevice final
+    {
+    public:
+        using Type = DeviceType;
+
+        BasicDevice(const std::uint8_t s, detail::Processor<Transport>* p) noexcept:
+            slot{s}, processor{p}
+        {}
+
+        [[nodiscard]] auto getType() const
+        {
+            return processor->readType(slot);
+        }
+
+        // not noexcept, a report that is read is published to the change callbacks, which are collected in allocated lists
+        [[nodiscard]] auto getType(std::error_code& error) const
+        {
+            return processor->readType(slot, error);
+        }
+
+        [[nodiscard]] auto getLatestType() const noexcept
+        {
+            return processor->getType(slot);
+        }
+
+        [[nodiscard]] auto getSlot() const noexcept { return slot; }
+        
+        std::uint8_t getValue() const
+        {
+            return processor->readValue(slot);
+        }
+
+        // may throw like getType(std::error_code&)
+        std::uint8_t getValue(std::error_code& error) const
+        {
+            return processor->readValue(slot, error);
+        }
+
+        [[nodiscard]] std::uint8_t getLatestValue() const noexcept
+        {
+            return processor->getValue(slot);
+        }
+
+        [[nodiscard]] std::uint8_t getOutputValue() const noexcept
+        {
+            return processor->getOutput(slot);
+        }
+
+        void setValue(std::uint8_t value) const
+        {
+            processor->writeValue(slot, value);
+        }
+
+        void setValue(std::uint8_t value, std::error_code& error) const noexcept(detail::Processor<Transport>::nothrowWrite)
+        {
+            processor->writeValue(slot, value, error);
+        }
+
+        std::size_t onChange(std::function<void(std::uint8_t)> callback, std::uint8_t threshold = 0U) const
+        {
+            return processor->subscribe(slot, threshold, std::move(callback));
+        }
+
+        void removeOnChange(std::size_t id) const
+        {
+            processor->unsubscribe(id);
+        }
+
+        std::size_t onTypeChange(std::function<void(Type)> callback) const
+        {
+            return processor->subscribeType(slot, std::move(callback));
+        }
+
+        void removeOnTypeChange(std::size_t id) const
+        {
+            processor->unsubscribe(id);
+        }
+
+        // an empty chain removes the filter
+        void setFilter(FilterChain chain) const
+        {
+            processor->setFilter(slot, std::move(chain));
+        }
+
+#ifdef WEDOPP_COROUTINES
+        // resumes with the new value once it differs from the latest one at the time of the call
+        [[nodiscard]] auto valueChanged() const noexcept
+        {
+            return detail::ValueAwaitable<Transport>{*processor, nullptr, slot};
+        }
+
+        [[nodiscard]] auto valueChanged(std::error_code& error) const noexcept
+        {
+            return detail::ValueAwaitable<Transport>{*processor, &error, slot};
+        }
+
+        // resumes once the value is written, the hub must be read by an EventLoop
+        [[nodiscard]] auto setValueAsync(std::uint8_t value) const noexcept requires std::is_same_v<Transport, detail::File>
+        {
+            return detail::WriteAwaitable{*processor, nullptr, slot, value};
+        }
+
+        [[nodiscard]] auto setValueAsync(std::uint8_t value, std::error_code& error) const noexcept requires std::is_same_v<Transport, detail::File>
+        {
+            return detail::WriteAwaitable{*processor, &error, slot, value};
+        }
+#endif
+        
+    private:
+        template <class>
+        friend class BasicOutputScheduler;
+
+        std::uint8_t slot = 0;
+        detail::Processor<Transport>* processor = nullptr;
+    };
+
+    class EventLoop;
+
+    // Transport must provide read(std::uint8_t*, std::size_t, std::chrono::milliseconds, std::error_code&)
+    // and write(const std::uint8_t*, std::size_t, std::chrono::milliseconds, std::error_code&)
+    template <class Transport>
+    class BasicHub final
+    {
+    public:
+        static constexpr std::size_t reportSize = detail::reportSize;
+
+        BasicHub(std::string n, std::string p, Transport t):
+            name{std::move(n)}, path{std::move(p)}, processor{std::move(t)},
+            devices{{BasicDevice<Transport>{0U, &processor}, BasicDevice<Transport>{1U, &processor}}}
+        {
+            if constexpr (std::is_same_v<Transport, detail::File>)
+                processor.setPath(path);
+        }
+
+        BasicHub(const BasicHub&) = delete;
+        BasicHub& operator=(const BasicHub&) = delete;
+        
+        [[nodiscard]] const auto& getName() const noexcept { return name; }
+        [[nodiscard]] const auto& getPath() const noexcept { return path; }
+        [[nodiscard]] const auto& getDevices() const noexcept { return devices; }
+
+        HubSnapshot poll()
+        {
+            return processor.poll();
+        }
+
+        // not noexcept, the report is passed to change callbacks and may use the allocator
+        HubSnapshot poll(std::error_code& error)
+        {
+            return processor.poll(error);
+        }
+
+        [[nodiscard]] HubSnapshot getSnapshot() const noexcept
+        {
+            return processor.getSnapshot();
+        }
+
+        [[nodiscard]] HubStats getStats() const noexcept
+        {
+            return processor.getStats();
+        }
+
+        // the recorder must outlive the recording, which stops when stopRecording returns
+        void startRecording(Recorder& recorder) noexcept
+        {
+            processor.setRecorder(&recorder);
+        }
+
+        void stopRecording() noexcept
+        {
+            processor.setRecorder(nullptr);
+        }
+
+        // reads a report directly into data, or copies the latest one if the hub is being read in the background
+        std::size_t readReport(std::uint8_t* data, std::size_t size)
+        {
+            std::error_code error;
+            const auto result = processor.readReport(data, size, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to read report"});
+            return result;
+        }
+
+        std::size_t readReport(std::uint8_t* data, std::size_t size, std::error_code& error)
+        {
+            return processor.readReport(data, size, error);
+        }
+
+        void writeReport(const std::uint8_t* data, std::size_t size)
+        {
+            std::error_code error;
+            processor.writeReport(data, size, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to write report"});
+        }
+
+        void writeReport(const std::uint8_t* data, std::size_t size, std::error_code& error) noexcept(detail::Processor<Transport>::nothrowWrite)
+        {
+            processor.writeReport(data, size, error);
+        }
+
+#ifdef WEDOPP_COROUTINES
+        // the hub must be read by an EventLoop or startReading, from whose thread the coroutine is resumed
+        [[nodiscard]] auto nextReport() noexcept
+        {
+            return detail::ReportAwaitable<Transport>{processor, nullptr};
+        }
+
+        [[nodiscard]] auto nextReport(std::error_code& error) noexcept
+        {
+            return detail::ReportAwaitable<Transport>{processor, &error};
+        }
+#endif
+
+        void startReading()
+        {
+            processor.start();
+        }
+
+        void stopReading()
+        {
+            processor.stop();
+        }
+
+        [[nodiscard]] bool isReading() const noexcept { return processor.isReading(); }
+
+        // HID hubs are reopened by path, other transports need an opener to reconnect
+        void setOpener(std::function<std::optional<Transport>(std::error_code&)> opener)
+        {
+            processor.setOpener(std::move(opener));
+        }
+
+        // makes the background reader reopen the hub every interval after it fails, until it succeeds or is stopped,
+        // the hub and its devices stay valid and values are kept
+        void enableReconnect(const std::chrono::milliseconds interval = std::chrono::milliseconds{500})
+        {
+            processor.setReconnectInterval(interval);
+        }
+
+        void disableReconnect()
+        {
+            processor.setReconnectInterval(std::chrono::milliseconds::zero());
+        }
+
+        // false while the background reader is reconnecting
+        [[nodiscard]] bool isConnected() const noexcept { return processor.isConnected(); }
+
+        void reconnect()
+        {
+            std::error_code error;
+            reconnect(error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to reconnect"});
+        }
+
+        // reopens the hub once in place, while it is not read in the background or by an EventLoop
+        bool reconnect(std::error_code& error)
+        {
+            if (processor.isDriven())
+            {
+                error = std::make_error_code(std::errc::device_or_resource_busy);
+                return false;
+            }
+
+            return processor.reopen(error);
+        }
+
+        void enableHistory(std::size_t capacity)
+        {
+            processor.enableHistory(capacity);
+        }
+
+        std::size_t getHistory(HubSnapshot* snapshots, std::size_t count) const noexcept
+        {
+            const auto history = processor.getHistory();
+            return history ? history->getLatest(snapshots, count) : 0U;
+        }
+
+        std::size_t getHistory(std::chrono::steady_clock::time_point since, HubSnapshot* snapshots, std::size_t count) const noexcept
+        {
+            const auto history = processor.getHistory();
+            return history ? history->getSince(since, snapshots, count) : 0U;
+        }
+
+        template <class Rep, class Period>
+        std::size_t getHistory(std::chrono::duration<Rep, Period> duration, HubSnapshot* snapshots, std::size_t count) const noexcept
+        {
+            return getHistory(std::chrono::steady_clock::now() - duration, snapshots, count);
+        }
+
+        void beginUpdate() noexcept
+        {
+            processor.beginUpdate();
+        }
+
+        void commit()
+        {
+            processor.commit();
+        }
+
+        void commit(std::error_code& error) noexcept(detail::Processor<Transport>::nothrowWrite)
+        {
+            processor.commit(error);
+        }
+
+    private:
+        friend EventLoop;
+
+        template <class, class>
+        friend class BasicHubGroup;
+
+        template <class Iterator>
+        friend std::size_t readAll(Iterator first, Iterator last, HubSnapshot* snapshots,
+                                   std::chrono::milliseconds timeout, std::error_code& error);
+
+        std::string name;
+        std::string path;
+        detail::Processor<Transport> processor;
+        std::array<BasicDevice<Transport>, 2> devices;
+    };
+
+    using HidTransport = detail::File;
+    using Device = BasicDevice<HidTransport>;
+    using Hub = BasicHub<HidTransport>;
+
+    // a device known to be of one type, whose values are converted without branching on the type
+    template <DeviceType type, class Transport>
+    class BasicTypedDevice final
+    {
+    public:
+        using Traits = DeviceTraits<type>;
+        using Value = typename Traits::Value;
+
+        explicit BasicTypedDevice(const BasicDevice<Transport>& d) noexcept: device{d} {}
+
+        [[nodiscard]] const auto& getDevice() const noexcept { return device; }
+
+        // the view does not check the type, call isConnected to do so
+        [[nodiscard]] bool isConnected() const noexcept
+        {
+            return device.getLatestType() == type;
+        }
+
+        [[nodiscard]] Value getValue() const
+        {
+            static_assert(Traits::isSensor, "Only sensors have values");
+            return Traits::decode(device.getValue());
+        }
+
+        [[nodiscard]] Value getValue(std::error_code& error) const
+        {
+            static_assert(Traits::isSensor, "Only sensors have values");
+            return Traits::decode(device.getValue(error));
+        }
+
+        [[nodiscard]] Value getLatestValue() const noexcept
+        {
+            static_assert(Traits::isSensor, "Only sensors have values");
+            return Traits::decode(device.getLatestValue());
+        }
+
+        [[nodiscard]] Value getValue(const HubSnapshot& snapshot) const noexcept
+        {
+            static_assert(Traits::isSensor, "Only sensors have values");
+            return Traits::decode(snapshot.getValue(device.getSlot()));
+        }
+
+        void setValue(const Value value) const
+        {
+            static_assert(Traits::isActuator, "Only actuators can be set");
+            device.setValue(Traits::encode(value));
+        }
+
+        void setValue(const Value value, std::error_code& error) const noexcept(detail::Processor<Transport>::nothrowWrite)
+        {
+            static_assert(Traits::isActuator, "Only actuators can be set");
+            device.setValue(Traits::encode(value), error);
+        }
+
+        [[nodiscard]] Value getOutputValue() const noexcept
+        {
+            static_assert(Traits::isActuator, "Only actuators can be set");
+            return Traits::decode(device.getOutputValue());
+        }
+
+        // moves the output from its current value to target over duration, as the scheduler ticks
+        void rampTo(BasicOutputScheduler<Transport>& scheduler, const Value target,
+                    const std::chrono::steady_clock::duration duration) const
+        {
+            scheduler.rampTo(*this, target, duration);
+        }
+
+    private:
+        BasicDevice<Transport> device;
+    };
+
+    template <DeviceType type>
+    using TypedDevice = BasicTypedDevice<type, HidTransport>;
+    using DistanceSensor = TypedDevice<DeviceType::distanceSensor>;
+    using TiltSensor = TypedDevice<DeviceType::tiltSensor>;
+    using Motor = TypedDevice<DeviceType::motor>;
+    using ServoMotor = TypedDevice<DeviceType::servoMotor>;
+    using Light = TypedDevice<DeviceType::light>;
+
+    // every tick writes one report to each hub with a ramping slot, with the values of all its ramping slots
+    template <class Transport>
+    class BasicOutputScheduler final
+    {
+    public:
+        template <DeviceType type>
+        void rampTo(const BasicTypedDevice<type, Transport>& device, const typename DeviceTraits<type>::Value target,
+                    const std::chrono::steady_clock::duration duration)
+        {
+            using Traits = DeviceTraits<type>;
+            static_assert(Traits::isActuator, "Only actuators can be ramped");
+
+            const auto& d = device.getDevice();
+            std::lock_guard lock{mutex};
+            findOrAdd(*d.processor).ramps[d.slot] = Ramp{
+                static_cast<int>(Traits::decode(d.getOutputValue())),
+                static_cast<int>(target),
+                std::chrono::steady_clock::now(),
+                duration,
+                [](const int value) noexcept { return Traits::encode(static_cast<typename Traits::Value>(value)); }
+            };
+        }
+
+        // the output keeps the last value it was ramped to
+        void cancel(const BasicDevice<Transport>& device)
+        {
+            std::lock_guard lock{mutex};
+            for (auto& hub : hubs)
+                if (hub.processor == device.processor)
+                    hub.ramps[device.slot].reset();
+        }
+
+        [[nodiscard]] bool isRamping() const
+        {
+            std::lock_guard lock{mutex};
+            return !hubs.empty();
+        }
+
+        void tick(const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now())
+        {
+            std::error_code error;
+            tick(now, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to write ramps"});
+        }
+
+        // a hub that fails to write keeps its ramps and the first error is returned
+        void tick(const std::chrono::steady_clock::time_point now, std::error_code& error)
+        {
+            error.clear();
+            std::lock_guard lock{mutex};
+
+            for (auto& hub : hubs)
+            {
+                hub.processor->beginUpdate();
+                for (std::uint8_t slot = 0U; slot < 2U; ++slot)
+                    if (auto& ramp = hub.ramps[slot])
+                    {
+                        const auto elapsed = std::max(now - ramp->start, std::chrono::steady_clock::duration::zero());
+                        const auto finished = elapsed >= ramp->duration;
+                        const auto value = finished ? ramp->to : ramp->from +
+                            static_cast<int>((ramp->to - ramp->from) * (static_cast<double>(elapsed.count()) / ramp->duration.count()));
+                        hub.processor->writeValue(slot, ramp->encode(value));
+                        if (finished) ramp.reset();
+                    }
+
+                std::error_code commitError;
+                hub.processor->commit(commitError);
+                if (commitError && !error) error = commitError;
+                else if (!commitError && !hub.ramps[0] && !hub.ramps[1])
+                    hub.processor = nullptr;
+            }
+
+            hubs.erase(std::remove_if(hubs.begin(), hubs.end(),
+                [](const auto& hub) noexcept { return hub.processor == nullptr; }), hubs.end());
+        }
+
+    private:
+        struct Ramp final
+        {
+            int from;
+            int to;
+            std::chrono::steady_clock::time_point start;
+            std::chrono::steady_clock::duration duration;
+            std::uint8_t (*encode)(int) noexcept;
+        };
+
+        struct HubRamps final
+        {
+            detail::Processor<Transport>* processor;
+            std::array<std::optional<Ramp>, 2> ramps;
+        };
+
+        HubRamps& findOrAdd(detail::Processor<Transport>& processor)
+        {
+            for (auto& hub : hubs)
+                if (hub.processor == &processor)
+                    return hub;
+            return hubs.emplace_back(HubRamps{&processor, {}});
+        }
+
+        mutable std::mutex mutex;
+        std::vector<HubRamps> hubs;
+    };
+
+    using OutputScheduler = BasicOutputScheduler<HidTransport>;
+
+    // copies share the same queues, so a copy can be kept to feed the hub that owns the other one
+    class MemoryTransport final
+    {
+    public:
+        MemoryTransport(): state{std::make_shared<State>()} {}
+
+        void pushReport(const std::array<std::uint8_t, 9>& report)
+        {
+            {
+                std::lock_guard lock{state->mutex};
+                state->reports.push_back(report);
+            }
+            state->condition.notify_all();
+        }
+
+        // makes reads and writes fail as if the hub was unplugged
+        void close()
+        {
+            {
+                std::lock_guard lock{state->mutex};
+                state->closed = true;
+            }
+            state->condition.notify_all();
+        }
+
+        [[nodiscard]] std::vector<std::array<std::uint8_t, 9>> takeWrittenReports() const
+        {
+            std::lock_guard lock{state->mutex};
+            return std::exchange(state->writtenReports, {});
+        }
+
+        void read(std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error) const
+        {
+            error.clear();
+
+            std::unique_lock lock{state->mutex};
+            const auto ready = [this]() noexcept { return state->closed || !state->reports.empty(); };
+            if (timeout == detail::infinite)
+                state->condition.wait(lock, ready);
+            else if (!state->condition.wait_for(lock, timeout, ready))
+            {
+                error = std::make_error_code(std::errc::timed_out);
+                return;
+            }
+
+            if (state->closed)
+            {
+                error = std::make_error_code(std::errc::no_such_device);
+                return;
+            }
+
+            const auto& report = state->reports.front();
+            std::copy_n(report.begin(), std::min(size, report.size()), data);
+            state->reports.pop_front();
+        }
+
+        void write(const std::uint8_t* data, const std::size_t size, std::chrono::milliseconds, std::error_code& error) const
+        {
+            error.clear();
+
+            std::lock_guard lock{state->mutex};
+            if (state->closed)
+            {
+                error = std::make_error_code(std::errc::no_such_device);
+                return;
+            }
+
+            auto& report = state->writtenReports.emplace_back();
+            std::copy_n(data, std::min(size, report.size()), report.begin());
+        }
+
+    private:
+        struct State final
+        {
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::deque<std::array<std::uint8_t, 9>> reports;
+            std::vector<std::array<std::uint8_t, 9>> writtenReports;
+            bool closed = false;
+        };
+
+        std::shared_ptr<State> state;
+    };
+
+    // plays the input reports of a recording back at their original pace multiplied by speed, or as fast as possible if speed is zero,
+    // and fails like an unplugged hub after the last report; writes are discarded
+    class ReplayTransport final
+    {
+    public:
+        explicit ReplayTransport(const std::string& filename, const double s = 1.0):
+            speed{s}
+        {
+            std::error_code error;
+            load(filename, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to load recording"});
+        }
+
+        ReplayTransport(const std::string& filename, const double s, std::error_code& error):
+            speed{s}
+        {
+            load(filename, error);
+        }
+
+        [[nodiscard]] const auto& getReports() const noexcept { return reports; }
+
+        void read(std::uint8_t* data, const std::size_t size, const std::chrono::milliseconds timeout, std::error_code& error)
+        {
+            error.clear();
+
+            if (position >= reports.size())
+            {
+                error = std::make_error_code(std::errc::no_such_device);
+                return;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (position == 0U) start = now;
+
+            const auto& recorded = reports[position];
+            if (speed > 0.0)
+            {
+                const auto target = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::nano>{static_cast<double>(recorded.time) / speed});
+
+                if (timeout != detail::infinite && target - now > timeout)
+                {
+                    std::this_thread::sleep_for(timeout);
+                    error = std::make_error_code(std::errc::timed_out);
+                    return;
+                }
+
+                std::this_thread::sleep_until(target);
+            }
+
+            std::copy_n(recorded.report.begin(), std::min(size, recorded.report.size()), data);
+            ++position;
+        }
+
+        void write(const std::uint8_t*, std::size_t, std::chrono::milliseconds, std::error_code& error) const noexcept
+        {
+            error.clear();
+        }
+
+    private:
+        void load(const std::string& filename, std::error_code& error)
+        {
+            error.clear();
+
+            using CloseFileFunction = int(*)(std::FILE*);
+            std::unique_ptr<std::FILE, CloseFileFunction> file(std::fopen(filename.c_str(), "rb"), &std::fclose);
+            if (!file)
+            {
+                error.assign(errno, std::generic_category());
+                return;
+            }
+
+            RecordedReport recorded;
+            while (std::fread(&recorded, sizeof(recorded), 1, file.get()) == 1 &&
+                   recorded.direction != RecordedReport::Direction::none)
+                if (recorded.direction == RecordedReport::Direction::input)
+                    reports.push_back(recorded);
+
+            if (std::ferror(file.get()))
+                error = std::make_error_code(std::errc::io_error);
+        }
+
+        double speed = 1.0;
+        std::vector<RecordedReport> reports;
+        std::size_t position = 0U;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    class EventLoop final
+    {
+    public:
+#ifdef _WIN32
+        EventLoop() = default;
+#else
+        EventLoop():
+            epollFd{epoll_create1(EPOLL_CLOEXEC)},
+            stopFd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+        {
+            if (epollFd == -1 || stopFd == -1)
+            {
+                const auto error = errno;
+                if (epollFd != -1) close(epollFd);
+                if (stopFd != -1) close(stopFd);
+                detail::raise(std::system_error{error, std::system_category(), "Failed to create event loop"});
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event) == -1)
+            {
+                const auto error = errno;
+                close(epollFd);
+                close(stopFd);
+                detail::raise(std::system_error{error, std::system_category(), "Failed to add stop event"});
+            }
+        }
+#endif
+
+        ~EventLoop()
+        {
+            for (const auto& entry : entries)
+                if (entry->hub)
+                {
+                    entry->hub->processor.detach();
+#ifdef _WIN32
+                    CancelIoEx(entry->hub->processor.getTransport().get(), nullptr);
+#elif defined(WEDOPP_COROUTINES)
+                    cancelWrites(*entry);
+#endif
+                    entry->hub = nullptr;
+                }
+
+#ifdef _WIN32
+            std::error_code error;
+            while ((pendingReads > 0U || pendingWrites > 0U) && !error)
+                port.runOnce(detail::infinite, error);
+#else
+            close(epollFd);
+            close(stopFd);
+#endif
+        }
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        void add(Hub& hub, std::function<void(const HubSnapshot&)> callback)
+        {
+            auto entry = std::make_unique<Entry>();
+            entry->hub = &hub;
+            entry->callback = std::move(callback);
+
+            const auto& file = hub.processor.getTransport();
+#ifdef _WIN32
+            port.associate(file.get());
+
+            std::error_code error;
+            read(*entry, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to read from file"});
+
+            hub.processor.attach();
+#ifdef WEDOPP_COROUTINES
+            hub.processor.setWriter([this, &processor = hub.processor](detail::WriteOperation& operation) {
+                return write(processor, operation);
+            });
+#endif
+            entries.push_back(std::move(entry));
+#else
+            file.setNonBlocking(true);
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = entry.get();
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, file.get(), &event) == -1)
+                detail::raise(std::system_error{errno, std::system_category(), "Failed to add hub to event loop"});
+
+            hub.processor.attach();
+#ifdef WEDOPP_COROUTINES
+            hub.processor.setWriter([this, e = entry.get()](detail::WriteOperation& operation) {
+                return write(*e, operation);
+            });
+#endif
+            entries.push_back(std::move(entry));
+#endif
+        }
+
+        void remove(Hub& hub)
+        {
+            for (const auto& entry : entries)
+                if (entry->hub == &hub)
+                {
+                    hub.processor.detach();
+#ifdef _WIN32
+                    CancelIoEx(hub.processor.getTransport().get(), nullptr);
+#else
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, hub.processor.getTransport().get(), nullptr);
+#ifdef WEDOPP_COROUTINES
+                    cancelWrites(*entry);
+#endif
+#endif
+                    entry->hub = nullptr;
+                }
+
+#ifndef _WIN32
+            if (!dispatching) collect();
+#endif
+        }
+
+        // sets both outputs of the hub to zero when nothing has been written to it for deadline, zero disables it
+        void setWatchdog(Hub& hub, const std::chrono::milliseconds deadline) noexcept
+        {
+            for (const auto& entry : entries)
+                if (entry->hub == &hub)
+                    entry->watchdog = deadline;
+        }
+
+        void stop()
+        {
+#ifdef _WIN32
+            port.stop();
+#else
+            const std::uint64_t value = 1U;
+            if (::write(stopFd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                detail::raise(std::system_error{errno, std::system_category(), "Failed to stop event loop"});
+#endif
+        }
+
+        void run()
+        {
+            while (runOnce(detail::infinite));
+        }
+
+        void run(std::error_code& error)
+        {
+            while (runOnce(detail::infinite, error));
+        }
+
+        bool runOnce(const std::chrono::milliseconds timeout)
+        {
+            std::error_code error;
+            const auto result = runOnce(timeout, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to process events"});
+            return result;
+        }
+
+        // a hub that fails to read is removed from the loop and its error is returned,
+        // and the call may return before the timeout to run watchdogs
+        bool runOnce(const std::chrono::milliseconds timeout, std::error_code& error)
+        {
+            error.clear();
+            const auto wait = std::min(timeout, checkWatchdogs(error));
+            if (error) return false;
+
+            const auto result = poll(wait, error);
+            if (error) return false;
+
+            checkWatchdogs(error);
+            return result && !error;
+        }
+
+    private:
+        struct Entry final
+        {
+            Hub* hub = nullptr;
+            std::function<void(const HubSnapshot&)> callback;
+            std::chrono::milliseconds watchdog{0};
+            std::chrono::steady_clock::rep stopped = 0; // the time of the command after which the outputs were stopped
+#ifdef _WIN32
+            std::array<std::uint8_t, 9> buffer{};
+#elif defined(WEDOPP_COROUTINES)
+            detail::WriteOperation* writers = nullptr; // waiting for the device to be writable
+#endif
+        };
+
+        // returns the time until the next watchdog is due
+        std::chrono::milliseconds checkWatchdogs(std::error_code& error)
+        {
+            auto wait = detail::infinite;
+            const auto now = std::chrono::steady_clock::now();
+            Hub* failed = nullptr;
+
+            for (const auto& entry : entries)
+            {
+                if (!entry->hub || entry->watchdog <= std::chrono::milliseconds::zero()) continue;
+
+                // a command may arrive while the loop waits, so it wakes up at least once per deadline
+                const auto last = entry->hub->processor.getLastCommandTime();
+                if (last == 0 || last == entry->stopped)
+                {
+                    wait = std::min(wait, entry->watchdog);
+                    continue;
+                }
+
+                const auto due = std::chrono::steady_clock::time_point{std::chrono::steady_clock::duration{last}} + entry->watchdog;
+                if (due > now)
+                {
+                    wait = std::min(wait, std::chrono::ceil<std::chrono::milliseconds>(due - now));
+                    continue;
+                }
+
+                entry->hub->processor.stopOutputs(error);
+                if (error)
+                {
+                    failed = entry->hub;
+                    break;
+                }
+                entry->stopped = last;
+            }
+
+            if (failed) remove(*failed);
+            return wait;
+        }
+
+        bool poll(const std::chrono::milliseconds timeout, std::error_code& error)
+        {
+#ifdef _WIN32
+            const auto result = port.runOnce(timeout, error);
+            if (!error && readError)
+            {
+                error = readError;
+                readError.clear();
+                return false;
+            }
+            return result;
+#else
+            const auto milliseconds = timeout == detail::infinite ? -1 :
+                static_cast<int>(std::min(timeout.count(), static_cast<std::chrono::milliseconds::rep>(INT_MAX)));
+
+            std::array<epoll_event, 64> events;
+            const auto count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), milliseconds);
+            if (count == -1)
+            {
+                if (errno == EINTR) return true;
+                error.assign(errno, std::system_category());
+                return false;
+            }
+
+            bool stopped = false;
+            dispatching = true;
+            for (int i = 0; i < count && !error; ++i)
+                if (const auto entry = static_cast<Entry*>(events[i].data.ptr))
+                {
+                    HubSnapshot snapshot;
+                    if (events[i].events != EPOLLOUT)
+                        while (entry->hub && entry->hub->processor.tryUpdate(snapshot, error))
+                            entry->callback(snapshot);
+
+                    if (error && entry->hub) remove(*entry->hub);
+#ifdef WEDOPP_COROUTINES
+                    if (!error && entry->hub && (events[i].events & EPOLLOUT)) resumeWrites(*entry);
+#endif
+                }
+                else
+                {
+                    std::uint64_t value;
+                    while (::read(stopFd, &value, sizeof(value)) != -1);
+                    stopped = true;
+                }
+            dispatching = false;
+            collect();
+
+            return !stopped && !error;
+#endif
+        }
+
+#ifdef _WIN32
+        void read(Entry& entry, std::error_code& error)
+        {
+            entry.hub->processor.getTransport().readAsync(entry.buffer, port,
+                [this, &entry](const std::error_code& status, std::size_t) {
+                    --pendingReads;
+                    if (entry.hub && !status)
+                    {
+                        entry.callback(entry.hub->processor.publish(entry.buffer));
+                        if (entry.hub)
+                        {
+                            std::error_code error;
+                            read(entry, error);
+                            if (!error) return;
+                            readError = error;
+                        }
+                    }
+                    else if (entry.hub)
+                        readError = status;
+
+                    discard(entry);
+                }, detail::infinite, error);
+
+            if (!error) ++pendingReads;
+        }
+
+        void discard(Entry& entry) noexcept
+        {
+            if (entry.hub) entry.hub->processor.detach();
+            entries.erase(std::find_if(entries.begin(), entries.end(),
+                [&entry](const auto& e) noexcept { return e.get() == &entry; }));
+        }
+
+#ifdef WEDOPP_COROUTINES
+        // the report of the operation is written with an overlapped write on the port, which resumes the coroutine
+        bool write(detail::Processor<detail::File>& processor, detail::WriteOperation& operation)
+        {
+            return processor.startWrite(operation.write, [this, &processor, &operation](const auto& report, std::error_code& error) {
+                processor.getTransport().writeAsync(report, port,
+                    [this, &processor, &operation](const std::error_code& status, std::size_t) {
+                        --pendingWrites;
+                        operation.error = status;
+                        processor.finishWrite(operation.write, operation.error);
+                        operation.handle.resume();
+                    }, detail::infinite, error);
+
+                if (!error) ++pendingWrites;
+            }, operation.error);
+        }
+#endif
+
+        detail::CompletionPort port;
+        std::size_t pendingReads = 0U;
+        std::atomic<std::size_t> pendingWrites{0U};
+        std::error_code readError;
+#else
+        void collect()
+        {
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                [](const auto& entry) noexcept { return entry->hub == nullptr; }), entries.end());
+        }
+
+#ifdef WEDOPP_COROUTINES
+        // the report is written right away if the device can take it, otherwise once epoll reports it writable
+        bool write(Entry& entry, detail::WriteOperation& operation)
+        {
+            if (entry.hub->processor.tryFlush(operation.error) || operation.error) return false;
+
+            std::lock_guard lock{writeMutex};
+            if (!entry.writers && !watchWrites(entry, true))
+            {
+                operation.error.assign(errno, std::system_category());
+                return false;
+            }
+
+            operation.next = entry.writers;
+            entry.writers = &operation;
+            return true;
+        }
+
+        void resumeWrites(Entry& entry)
+        {
+            detail::WriteOperation* ready = nullptr;
+            {
+                std::lock_guard lock{writeMutex};
+                std::swap(ready, entry.writers);
+                if (!ready)
+                {
+                    watchWrites(entry, false);
+                    return;
+                }
+            }
+
+            // the writes of all operations taken are queued before they suspended, so one report covers them
+            std::error_code error;
+            if (!entry.hub->processor.tryFlush(error) && !error)
+            {
+                std::lock_guard lock{writeMutex};
+                auto last = ready;
+                while (last->next) last = last->next;
+                last->next = entry.writers;
+                entry.writers = ready;
+                return;
+            }
+
+            {
+                std::lock_guard lock{writeMutex};
+                if (!entry.writers) watchWrites(entry, false);
+            }
+
+            resume(ready, error);
+        }
+
+        void cancelWrites(Entry& entry)
+        {
+            detail::WriteOperation* ready = nullptr;
+            {
+                std::lock_guard lock{writeMutex};
+                std::swap(ready, entry.writers);
+            }
+            resume(ready, std::make_error_code(std::errc::operation_canceled));
+        }
+
+        static void resume(detail::WriteOperation* ready, const std::error_code& error)
+        {
+            // a resumed coroutine may write again or finish and free its operation
+            while (ready)
+            {
+                auto& operation = *ready;
+                ready = operation.next;
+                operation.error = error;
+                operation.handle.resume();
+            }
+        }
+
+        bool watchWrites(const Entry& entry, const bool writes) noexcept
+        {
+            epoll_event event{};
+            event.events = writes ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.ptr = const_cast<Entry*>(&entry);
+            return epoll_ctl(epollFd, EPOLL_CTL_MOD, entry.hub->processor.getTransport().get(), &event) != -1;
+        }
+
+        std::mutex writeMutex;
+#endif
+
+        int epollFd = -1;
+        int stopFd = -1;
+        bool dispatching = false;
+#endif
+        std::vector<std::unique_ptr<Entry>> entries;
+    };
+
+    // reads one report from every hub at once, the snapshot of a hub that timed out or failed is its latest one,
+    // not noexcept because reads call the change callbacks of the hubs
+    template <class Iterator>
+    std::size_t readAll(const Iterator first, const Iterator last, HubSnapshot* snapshots,
+                        const std::chrono::milliseconds timeout, std::error_code& error)
+    {
+        error.clear();
+        std::size_t completed = 0U;
+
+        const auto fail = [&error](const std::error_code& e) noexcept {
+            if (!error) error = e;
+        };
+
+        const auto deadline = timeout == detail::infinite ?
+            std::chrono::steady_clock::time_point::max() :
+            std::chrono::steady_clock::now() + timeout;
+
+        const auto getRemaining = [deadline]() noexcept {
+            if (deadline == std::chrono::steady_clock::time_point::max()) return detail::infinite;
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            return std::max(remaining, std::chrono::milliseconds{0});
+        };
+
+        using Processor = std::remove_reference_t<decltype(first->processor)>;
+        constexpr auto isHid = std::is_same_v<Processor, detail::Processor<detail::File>>;
+
+#ifdef _WIN32
+        struct Read final
+        {
+            Processor* processor;
+            std::size_t index;
+            OVERLAPPED overlapped;
+            std::array<std::uint8_t, 9> report;
+        };
+
+        // reads are kept in place while the overlapped operations are in flight
+        std::vector<Read> reads;
+        reads.reserve(static_cast<std::size_t>(std::distance(first, last)));
+#else
+        struct Read final
+        {
+            Processor* processor;
+            std::size_t index;
+        };
+
+        std::vector<Read> reads;
+        std::vector<pollfd> pollFds;
+#endif
+
+        std::size_t index = 0U;
+        for (auto i = first; i != last; ++i, ++index)
+        {
+            auto& processor = i->processor;
+            snapshots[index] = processor.getSnapshot();
+
+            std::error_code readError;
+            if (processor.isDriven())
+            {
+                snapshots[index] = processor.poll(readError);
+                if (readError)
+                    fail(readError);
+                else
+                    ++completed;
+                continue;
+            }
+
+            if constexpr (isHid)
+            {
+#ifdef _WIN32
+                if (processor.getTransport().isOverlapped())
+                {
+                    auto& read = reads.emplace_back();
+                    read.processor = &processor;
+                    read.index = index;
+                    processor.getTransport().startRead(read.report.data(), read.report.size(), read.overlapped, readError);
+                    if (readError)
+                    {
+                        fail(readError);
+                        reads.pop_back();
+                    }
+                    continue;
+                }
+#else
+                reads.push_back(Read{&processor, index});
+                pollFds.push_back(pollfd{processor.getTransport().get(), POLLIN, 0});
+                continue;
+#endif
+            }
+
+            // other transports are read one after another
+            snapshots[index] = processor.update(getRemaining(), readError);
+            if (!readError)
+                ++completed;
+            else if (readError != std::errc::timed_out)
+                fail(readError);
+        }
+
+        if constexpr (isHid)
+        {
+#ifdef _WIN32
+            // every read is already in flight, so waiting on them in turn takes as long as the slowest one
+            for (auto& read : reads)
+            {
+                std::error_code readError;
+                read.processor->getTransport().finishRead(read.overlapped, getRemaining(), readError);
+                if (readError)
+                {
+                    if (readError != std::errc::timed_out) fail(readError);
+                    continue;
+                }
+
+                snapshots[read.index] = read.processor->publish(read.report);
+                ++completed;
+            }
+#else
+            while (!pollFds.empty())
+            {
+                const auto remaining = getRemaining();
+                const auto milliseconds = remaining == detail::infinite ? -1 :
+                    static_cast<int>(std::min(remaining.count(), static_cast<std::chrono::milliseconds::rep>(INT_MAX)));
+
+                const auto result = poll(pollFds.data(), static_cast<nfds_t>(pollFds.size()), milliseconds);
+                if (result == -1)
+                {
+                    if (errno == EINTR) continue;
+                    fail(std::error_code{errno, std::system_category()});
+                    break;
+                }
+
+                if (result == 0) break;
+
+                for (auto i = pollFds.size(); i-- > 0U;)
+                {
+                    if (!pollFds[i].revents) continue;
+
+                    std::error_code readError;
+                    HubSnapshot snapshot;
+                    if (reads[i].processor->tryUpdate(snapshot, readError))
+                    {
+                        snapshots[reads[i].index] = snapshot;
+                        ++completed;
+                    }
+                    else if (readError)
+                        fail(readError);
+                    else
+                        continue;
+
+                    pollFds[i] = pollFds.back();
+                    pollFds.pop_back();
+                    reads[i] = reads.back();
+                    reads.pop_back();
+                }
+            }
+#endif
+        }
+
+        return completed;
+    }
+
+    template <class Iterator>
+    std::size_t readAll(const Iterator first, const Iterator last, HubSnapshot* snapshots,
+                        const std::chrono::milliseconds timeout = detail::infinite)
+    {
+        std::error_code error;
+        const auto result = readAll(first, last, snapshots, timeout, error);
+        if (error)
+            detail::raise(std::system_error{error, "Failed to read from hubs"});
+        return result;
+    }
+
+    namespace detail
+    {
+        enum class Comparison
+        {
+            lessOrEqual,
+            equal
+        };
+
+#if defined(WEDOPP_SSE2)
+        inline std::uint16_t compare16(const std::uint8_t* values, const __m128i references, const Comparison comparison) noexcept
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+            // unsigned v <= reference is min(v, reference) == v
+            const auto result = comparison == Comparison::lessOrEqual ?
+                _mm_cmpeq_epi8(_mm_min_epu8(v, references), v) :
+                _mm_cmpeq_epi8(v, references);
+            return static_cast<std::uint16_t>(_mm_movemask_epi8(result));
+        }
+
+        // sets each byte whose bit is set in the 16 bits to 0xFF
+        inline __m128i expand16(const std::uint64_t bits) noexcept
+        {
+            constexpr std::uint64_t broadcast = 0x0101010101010101U;
+            const auto bitsOfBytes = _mm_set1_epi64x(static_cast<long long>(0x8040201008040201U));
+            const auto bytes = _mm_set_epi64x(static_cast<long long>(((bits >> 8U) & 0xFFU) * broadcast),
+                                              static_cast<long long>((bits & 0xFFU) * broadcast));
+            return _mm_cmpeq_epi8(_mm_and_si128(bytes, bitsOfBytes), bitsOfBytes);
+        }
+#elif defined(WEDOPP_NEON)
+        inline std::uint16_t compare16(const std::uint8_t* values, const uint8x16_t references, const Comparison comparison) noexcept
+        {
+            const auto v = vld1q_u8(values);
+            const auto result = comparison == Comparison::lessOrEqual ? vcleq_u8(v, references) : vceqq_u8(v, references);
+            const auto bits = vandq_u8(result, vreinterpretq_u8_u64(vdupq_n_u64(0x8040201008040201U)));
+            return static_cast<std::uint16_t>(vaddv_u8(vget_low_u8(bits)) | (vaddv_u8(vget_high_u8(bits)) << 8U));
+        }
+
+        inline uint8x16_t expand16(const std::uint64_t bits) noexcept
+        {
+            constexpr std::uint64_t broadcast = 0x0101010101010101U;
+            const auto bitsOfBytes = vreinterpretq_u8_u64(vdupq_n_u64(0x8040201008040201U));
+            const auto bytes = vcombine_u8(vcreate_u8((bits & 0xFFU) * broadcast), vcreate_u8(((bits >> 8U) & 0xFFU) * broadcast));
+            return vtstq_u8(bytes, bitsOfBytes);
+        }
+#endif
+
+        template <Comparison comparison>
+        void compare(const std::uint8_t* values, const std::size_t count,
+                     const std::uint8_t reference, std::uint64_t* mask) noexcept
+        {
+            std::uint64_t word = 0U;
+            std::size_t i = 0U;
+
+#if defined(WEDOPP_SSE2) || defined(WEDOPP_NEON)
+#  ifdef WEDOPP_SSE2
+            const auto references = _mm_set1_epi8(static_cast<char>(reference));
+#  else
+            const auto references = vdupq_n_u8(reference);
+#  endif
+            for (; i + 64U <= count; i += 64U)
+                mask[i / 64U] = std::uint64_t{compare16(values + i, references, comparison)} |
+                    (std::uint64_t{compare16(values + i + 16U, references, comparison)} << 16U) |
+                    (std::uint64_t{compare16(values + i + 32U, references, comparison)} << 32U) |
+                    (std::uint64_t{compare16(values + i + 48U, references, comparison)} << 48U);
+
+            for (; i + 16U <= count; i += 16U)
+                word |= std::uint64_t{compare16(values + i, references, comparison)} << (i % 64U);
+#endif
+
+            for (; i < count; ++i)
+            {
+                const bool bit = comparison == Comparison::lessOrEqual ? values[i] <= reference : values[i] == reference;
+                word |= std::uint64_t{bit} << (i % 64U);
+                if (i % 64U == 63U)
+                {
+                    mask[i / 64U] = word;
+                    word = 0U;
+                }
+            }
+
+            if (count % 64U) mask[count / 64U] = word;
+        }
+    }
+
+    // bit i % 64 of mask[i / 64] is set if values[i] <= threshold, mask must have room for (count + 63) / 64 words
+    inline void compareLE(const std::uint8_t* values, const std::size_t count,
+                          const std::uint8_t threshold, std::uint64_t* mask) noexcept
+    {
+        detail::compare<detail::Comparison::lessOrEqual>(values, count, threshold, mask);
+    }
+
+    inline void compareEqual(const std::uint8_t* values, const std::size_t count,
+                             const std::uint8_t value, std::uint64_t* mask) noexcept
+    {
+        detail::compare<detail::Comparison::equal>(values, count, value, mask);
+    }
+
+    inline void compareEqual(const DeviceType* types, const std::size_t count,
+                             const DeviceType type, std::uint64_t* mask) noexcept
+    {
+        detail::compare<detail::Comparison::equal>(reinterpret_cast<const std::uint8_t*>(types), count,
+                                                   static_cast<std::uint8_t>(type), mask);
+    }
+
+    // outputs[i] is onValue if bit i of mask is set and offValue otherwise
+    inline void selectOutputs(const std::uint64_t* mask, const std::size_t count,
+                              const std::uint8_t onValue, const std::uint8_t offValue, std::uint8_t* outputs) noexcept
+    {
+        std::size_t i = 0U;
+
+#if defined(WEDOPP_SSE2)
+        const auto on = _mm_set1_epi8(static_cast<char>(onValue));
+        const auto off = _mm_set1_epi8(static_cast<char>(offValue));
+        for (; i + 16U <= count; i += 16U)
+        {
+            const auto selected = detail::expand16(mask[i / 64U] >> (i % 64U));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(outputs + i),
+                             _mm_or_si128(_mm_and_si128(selected, on), _mm_andnot_si128(selected, off)));
+        }
+#elif defined(WEDOPP_NEON)
+        const auto on = vdupq_n_u8(onValue);
+        const auto off = vdupq_n_u8(offValue);
+        for (; i + 16U <= count; i += 16U)
+            vst1q_u8(outputs + i, vbslq_u8(detail::expand16(mask[i / 64U] >> (i % 64U)), on, off));
+#endif
+
+        for (; i < count; ++i)
+        {
+            const auto selected = static_cast<std::uint8_t>(0U - ((mask[i / 64U] >> (i % 64U)) & 1U));
+            outputs[i] = static_cast<std::uint8_t>((onValue & selected) | (offValue & ~selected));
+        }
+    }
+
+    // keeps the types, values and outputs of all slots of its hubs in contiguous arrays,
+    // where slot s of hub h is at index h * 2 + s
+    template <class Transport, class Allocator = std::allocator<BasicHub<Transport>>>
+    class BasicHubGroup final
+    {
+    public:
+        explicit BasicHubGroup(std::deque<BasicHub<Transport>, Allocator> h):
+            hubs{std::move(h)},
+            snapshots(hubs.size()),
+            types(hubs.size() * 2U, DeviceType::none),
+            values(hubs.size() * 2U),
+            outputs(hubs.size() * 2U)
+        {
+            for (std::size_t i = 0; i < hubs.size(); ++i)
+                for (const auto& device : hubs[i].getDevices())
+                    outputs[i * 2U + device.getSlot()] = device.getOutputValue();
+        }
+
+        BasicHubGroup(const BasicHubGroup&) = delete;
+        BasicHubGroup& operator=(const BasicHubGroup&) = delete;
+
+        [[nodiscard]] auto size() const noexcept { return hubs.size(); }
+        [[nodiscard]] auto& getHubs() noexcept { return hubs; }
+        [[nodiscard]] const auto& getHubs() const noexcept { return hubs; }
+        [[nodiscard]] const auto& getSnapshots() const noexcept { return snapshots; }
+        [[nodiscard]] const auto& getTypes() const noexcept { return types; }
+        [[nodiscard]] const auto& getValues() const noexcept { return values; }
+
+        // set the outputs and call writeAll to write them
+        [[nodiscard]] auto& getOutputs() noexcept { return outputs; }
+        [[nodiscard]] const auto& getOutputs() const noexcept { return outputs; }
+
+        std::size_t readAll(const std::chrono::milliseconds timeout = detail::infinite)
+        {
+            std::error_code error;
+            const auto result = readAll(timeout, error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to read from hubs"});
+            return result;
+        }
+
+        // reads all hubs at once, the slots of a hub that timed out or failed keep their latest values
+        std::size_t readAll(const std::chrono::milliseconds timeout, std::error_code& error)
+        {
+            const auto result = wedopp::readAll(hubs.begin(), hubs.end(), snapshots.data(), timeout, error);
+
+            for (std::size_t i = 0; i < snapshots.size(); ++i)
+                for (std::uint8_t slot = 0U; slot < 2U; ++slot)
+                {
+                    types[i * 2U + slot] = snapshots[i].getType(slot);
+                    values[i * 2U + slot] = snapshots[i].getValue(slot);
+                }
+
+            return result;
+        }
+
+        void writeAll()
+        {
+            std::error_code error;
+            writeAll(error);
+            if (error)
+                detail::raise(std::system_error{error, "Failed to write to hubs"});
+        }
+
+        // writes one report to each hub whose outputs differ from the last report sent, all at once,
+        // a hub that fails does not stop the others
+        void writeAll(std::error_code& error)
+        {
+            error.clear();
+
+            const auto fail = [&error](const std::error_code& e) noexcept {
+                if (!error) error = e;
+            };
+
+            constexpr auto isHid = std::is_same_v<Transport, detail::File>;
+
+#ifdef _WIN32
+            struct Write final
+            {
+                detail::Processor<Transport>* processor;
+                detail::Event event;
+                OVERLAPPED overlapped;
+                detail::PendingWrite write;
+            };
+
+            // writes are kept in place while the overlapped operations are in flight
+            std::vector<Write> writes;
+            if constexpr (isHid) writes.reserve(hubs.size());
+#else
+            std::vector<detail::Processor<Transport>*> writes;
+            std::vector<pollfd> pollFds;
+#endif
+
+            for (std::size_t i = 0; i < hubs.size(); ++i)
+            {
+                auto& processor = hubs[i].processor;
+                std::error_code hubError;
+                processor.beginUpdate();
+                for (const auto& device : hubs[i].getDevices())
+                    if (!hubError) device.setValue(outputs[i * 2U + device.getSlot()], hubError);
+
+                auto parallel = isHid && !hubError;
+#ifdef _WIN32
+                if constexpr (isHid)
+                    parallel = parallel && processor.getTransport().isOverlapped();
+#endif
+                if (!parallel)
+                {
+                    // other transports are written one after another
+                    std::error_code commitError;
+                    processor.commit(commitError);
+                    if (!hubError) hubError = commitError;
+                    if (hubError) fail(hubError);
+                    continue;
+                }
+
+                // an update block of the caller that is still open writes the outputs when it is committed
+                if (!processor.endUpdate()) continue;
+
+                // the hub skips the write itself when the report equals the one sent, so a failed write is retried
+                if constexpr (isHid)
+                {
+#ifdef _WIN32
+                    auto& write = writes.emplace_back(Write{&processor, detail::Event{true, hubError}, OVERLAPPED{}, {}});
+                    const auto& file = processor.getTransport();
+                    if (hubError ||
+                        !processor.startWrite(write.write, [&file, &write](const auto& report, std::error_code& e) {
+                            file.startWrite(report.data(), report.size(), write.overlapped, write.event, e);
+                        }, hubError))
+                    {
+                        writes.pop_back();
+                        if (hubError) fail(hubError);
+                    }
+#else
+                    if (!processor.tryFlush(hubError))
+                    {
+                        writes.push_back(&processor);
+                        pollFds.push_back(pollfd{processor.getTransport().get(), POLLOUT, 0});
+                    }
+                    else if (hubError)
+                        fail(hubError);
+#endif
+                }
+            }
+
+            if constexpr (isHid)
+            {
+#ifdef _WIN32
+                // every write is already in flight, so waiting on them in turn takes as long as the slowest one
+                for (auto& write : writes)
+                {
+                    std::error_code writeError;
+                    write.processor->getTransport().finishWrite(write.overlapped, write.event, detail::infinite, writeError);
+                    write.processor->finishWrite(write.write, writeError);
+                    if (writeError) fail(writeError);
+                }
+#else
+                while (!pollFds.empty())
+                {
+                    if (poll(pollFds.data(), static_cast<nfds_t>(pollFds.size()), -1) == -1)
+                    {
+                        if (errno == EINTR) continue;
+                        fail(std::error_code{errno, std::system_category()});
+                        break;
+                    }
+
+                    for (auto i = pollFds.size(); i-- > 0U;)
+                    {
+                        if (!pollFds[i].revents) continue;
+
+                        std::error_code writeError;
+                        if (!writes[i]->tryFlush(writeError)) continue;
+                        if (writeError) fail(writeError);
+
+                        pollFds[i] = pollFds.back();
+                        pollFds.pop_back();
+                        writes[i] = writes.back();
+                        writes.pop_back();
+                    }
+                }
+#endif
+            }
+        }
+
+    private:
+        std::deque<BasicHub<Transport>, Allocator> hubs;
+        std::vector<HubSnapshot> snapshots;
+        std::vector<DeviceType> types;
+        std::vector<std::uint8_t> values;
+        std::vector<std::uint8_t> outputs;
+    };
+
+    using HubGroup = BasicHubGroup<HidTransport>;
+
+    namespace detail
+    {
+        inline constexpr std::uint16_t vendorId = 0x0694;
+        inline constexpr std::uint16_t productId = 0x0003;
+
+        struct HubDescriptor final
+        {
+            std::string name;
+            std::string path;
+            File file;
+        };
+
+        WEDOPP_INLINE std::optional<HubDescriptor> openHub(const std::string& path, std::error_code& error);
+        WEDOPP_INLINE std::vector<std::string> getCandidatePaths(const bool filterHardwareId, std::error_code& error);
+    }
+
+#ifdef WEDOPP_SOURCES
+    namespace detail
+    {
+#ifdef _WIN32
+        WEDOPP_INLINE std::optional<HubDescriptor> openHub(const std::string& path, std::error_code& error)
+        {
+            detail::File file{path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, FILE_FLAG_WRITE_THROUGH | FILE_FLAG_OVERLAPPED, error};
+            if (error) return std::nullopt;
+
+            HIDD_ATTRIBUTES attributes{};
+            attributes.Size = sizeof(attributes);
+            if (!HidD_GetAttributes(file.get(), &attributes) ||
+                attributes.VendorID != vendorId || attributes.ProductID != productId)
+                return std::nullopt;
+
+            WCHAR deviceName[256];
+            if (!HidD_GetProductString(file.get(), deviceName, sizeof(deviceName)))
+            {
+                error.assign(static_cast<int>(GetLastError()), std::system_category());
+                return std::nullopt;
+            }
+
+            const auto byteCount = WideCharToMultiByte(CP_UTF8, 0, deviceName, -1, nullptr, 0, nullptr, nullptr);
+            if (byteCount == 0)
+            {
+                error.assign(static_cast<int>(GetLastError()), std::system_category());
+                return std::nullopt;
+            }
+
+            auto buffer = std::make_unique<char[]>(byteCount);
+            if (WideCharToMultiByte(CP_UTF8, 0, deviceName, -1, buffer.get(), byteCount, nullptr, nullptr) == 0)
+            {
+                error.assign(static_cast<int>(GetLastError()), std::system_category());
+                return std::nullopt;
+            }
+
+            return HubDescriptor{buffer.get(), path, std::move(file)};
+        }
+#else
+        WEDOPP_INLINE std::optional<HubDescriptor> openHub(const std::string& path, std::error_code& error)
+        {
+            detail::File file{path, O_RDWR | O_NONBLOCK, error};
+            if (error) return std::nullopt;
+
+            struct hiddev_devinfo devinfo;
+            if (ioctl(file.get(), HIDIOCGDEVINFO, &devinfo) == -1)
+            {
+                error.assign(errno, std::system_category());
+                return std::nullopt;
+            }
+
+            if (devinfo.vendor != vendorId || devinfo.product != productId)
+                return std::nullopt;
+
+            char deviceName[256]{};
+            if (ioctl(file.get(), HIDIOCGNAME(sizeof(deviceName) - 1), deviceName) == -1)
+            {
+                error.assign(errno, std::system_category());
+                return std::nullopt;
+            }
+
+            return HubDescriptor{deviceName, path, std::move(file)};
+        }
+#endif
+
+        WEDOPP_INLINE std::optional<File> reopenHub(const std::string& path, std::error_code& error)
+        {
+            if (auto hub = openHub(path, error))
+                return std::move(hub->file);
+            return std::nullopt;
+        }
+    }
+
+    namespace detail
+    {
+#ifdef _WIN32
+        inline bool matchesHardwareId(const std::string& path)
+        {
+            std::string lowerPath = path;
+            std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(),
+                [](const char c) noexcept { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+            return lowerPath.find("vid_0694&pid_0003") != std::string::npos;
+        }
+#else
+        // returns true also when sysfs can not be read, so that the device gets probed
+        inline bool matchesHardwareId(const std::string& name)
+        {
+            const auto readId = [&name](const char* attribute) {
+                using CloseFileFunction = int(*)(std::FILE*);
+                const auto filename = "/sys/class/usbmisc/" + name + "/device/../" + attribute;
+                std::unique_ptr<std::FILE, CloseFileFunction> file(std::fopen(filename.c_str(), "r"), &std::fclose);
+
+                unsigned int id = 0;
+                return file && std::fscanf(file.get(), "%x", &id) == 1 ? static_cast<int>(id) : -1;
+            };
+
+            const auto vendor = readId("idVendor");
+            const auto product = readId("idProduct");
+            return (vendor == -1 || vendor == vendorId) && (product == -1 || product == productId);
+        }
+#endif
+
+        WEDOPP_INLINE std::vector<std::string> getCandidatePaths(const bool filterHardwareId, std::error_code& error)
+        {
+            std::vector<std::string> paths;
+
+#ifdef _WIN32
+            GUID hidGuid;
+            HidD_GetHidGuid(&hidGuid);
+            detail::DevInfo devInfo{&hidGuid, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE | DIGCF_ALLCLASSES, error};
+            if (error) return paths;
+
+            for (DWORD index = 0;; ++index)
+            {
+                SP_DEVICE_INTERFACE_DATA interfaceData{};
+                interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+
+                if (!SetupDiEnumDeviceInterfaces(devInfo.get(), nullptr, &hidGuid, index, &interfaceData))
+                {
+                    if (const auto result = GetLastError(); result != ERROR_NO_MORE_ITEMS)
+                        error.assign(static_cast<int>(result), std::system_category());
+                    break;
+                }
+
+                DWORD requiredLength = 0;
+                if (!SetupDiGetDeviceInterfaceDetailA(devInfo.get(), &interfaceData, nullptr, 0, &requiredLength, nullptr))
+                    if (const auto result = GetLastError(); result != ERROR_INSUFFICIENT_BUFFER)
+                    {
+                        error.assign(static_cast<int>(result), std::system_category());
+                        break;
+                    }
+
+                detail::InterfaceDetailData interfaceDetailData{requiredLength};
+
+                if (!SetupDiGetDeviceInterfaceDetailA(devInfo.get(), &interfaceData, interfaceDetailData.get(), requiredLength, &requiredLength, nullptr))
+                {
+                    error.assign(static_cast<int>(GetLastError()), std::system_category());
+                    break;
+                }
+
+                if (!filterHardwareId || matchesHardwareId(interfaceDetailData->DevicePath))
+                    paths.push_back(interfaceDetailData->DevicePath);
+            }
+#else
+            using CloseDirFunction = int(*)(DIR*);
+            std::unique_ptr<DIR, CloseDirFunction> dir(opendir("/dev/usb"), &closedir);
+            if (!dir)
+            {
+                error.assign(errno, std::system_category());
+                return paths;
             }
 
-        private:
-            detail::File file;
-            std::array<std::uint8_t, 9> readBuffer{};
-            std::array<std::uint8_t, 9> writeBuffer{};
-        };
+            while (const dirent* ent = readdir(dir.get()))
+                if (std::strncmp("hid", ent->d_name, 3) == 0 &&
+                    (!filterHardwareId || matchesHardwareId(ent->d_name)))
+                    paths.push_back(std::string("/dev/usb/") + ent->d_name);
+#endif
+
+            return paths;
+        }
     }
+#endif
 
-    class Device final
+    // errors are returned in error, but allocating the hubs and their paths may still throw std::bad_alloc
+    template <class Allocator = std::allocator<Hub>>
+    [[nodiscard]] std::deque<Hub, Allocator> findHubs(std::error_code& error, const Allocator& allocator = Allocator{})
     {
-    public:
-        enum class Type: std::uint8_t
+        std::deque<Hub, Allocator> hubs{allocator};
+
+        const auto paths = detail::getCandidatePaths(false, error);
+        if (error) return hubs;
+
+        // nodes that can not be opened, for example without permission, are skipped
+        for (const auto& path : paths)
+        {
+            std::error_code openError;
+            if (auto hub = detail::openHub(path, openError))
+                hubs.emplace_back(std::move(hub->name), std::move(hub->path), std::move(hub->file));
+        }
+
+        return hubs;
+    }
+
+    template <class Allocator = std::allocator<Hub>>
+    [[nodiscard]] std::deque<Hub, Allocator> findHubs(const Allocator& allocator = Allocator{})
+    {
+        std::error_code error;
+        auto hubs = findHubs(error, allocator);
+        if (error)
+            detail::raise(std::system_error{error, "Failed to enumerate devices"});
+        return hubs;
+    }
+
+    struct FindOptions final
+    {
+        std::size_t threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+        std::chrono::milliseconds timeout = detail::infinite;
+        bool filterHardwareId = true;
+    };
+
+    template <class Allocator = std::allocator<Hub>>
+    [[nodiscard]] std::deque<Hub, Allocator> findHubs(const FindOptions& options, std::error_code& error, const Allocator& allocator = Allocator{})
+    {
+        struct State final
         {
-            none,
-            motor,
-            servoMotor,
-            light,
-            distanceSensor,
-            tiltSensor
+            explicit State(std::vector<std::string> p):
+                paths{std::move(p)}, results(paths.size()), startTimes(paths.size()), finished(paths.size(), false)
+            {}
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::vector<std::string> paths;
+            std::vector<std::optional<detail::HubDescriptor>> results;
+            std::vector<std::chrono::steady_clock::time_point> startTimes;
+            std::vector<bool> finished;
+            std::size_t next = 0U;
+            std::size_t finishedCount = 0U;
         };
 
-        Device(const std::uint8_t s, detail::Processor* p) noexcept:
-            slot{s}, processor{p}
-        {}
+        std::deque<Hub, Allocator> hubs{allocator};
 
-        [[nodiscard]] auto getType() const
+        auto paths = detail::getCandidatePaths(options.filterHardwareId, error);
+        if (error) return hubs;
+
+        const auto state = std::make_shared<State>(std::move(paths));
+        const auto count = state->paths.size();
+
+        // workers are detached, a probe that hangs past the timeout is abandoned and replaced
+        const auto startWorker = [state]() {
+            std::thread{[state]() {
+                std::unique_lock lock{state->mutex};
+                while (state->next < state->paths.size())
+                {
+                    const auto index = state->next++;
+                    state->startTimes[index] = std::chrono::steady_clock::now();
+                    lock.unlock();
+
+                    std::error_code openError;
+                    auto hub = detail::openHub(state->paths[index], openError);
+
+                    lock.lock();
+                    if (state->finished[index]) return;
+
+                    state->results[index] = std::move(hub);
+                    state->finished[index] = true;
+                    ++state->finishedCount;
+                    state->condition.notify_all();
+                }
+            }}.detach();
+        };
+
+        for (std::size_t i = 0; i < std::min(std::max(options.threadCount, std::size_t{1U}), count); ++i)
+            startWorker();
+
+        std::unique_lock lock{state->mutex};
+        while (state->finishedCount < count)
         {
-            return getDeviceType(processor->readType(slot));
+            if (options.timeout == detail::infinite)
+            {
+                state->condition.wait(lock);
+                continue;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            auto deadline = std::chrono::steady_clock::time_point::max();
+            for (std::size_t i = 0; i < state->next; ++i)
+                if (!state->finished[i])
+                {
+                    if (const auto probeDeadline = state->startTimes[i] + options.timeout; probeDeadline > now)
+                        deadline = std::min(deadline, probeDeadline);
+                    else
+                    {
+                        state->finished[i] = true;
+                        ++state->finishedCount;
+                        if (state->next < count) startWorker();
+                    }
+                }
+
+            if (state->finishedCount >= count) break;
+
+            if (deadline == std::chrono::steady_clock::time_point::max())
+                state->condition.wait(lock);
+            else
+                state->condition.wait_until(lock, deadline);
         }
 
-        [[nodiscard]] auto getSlot() const noexcept { return slot; }
-        
-        std::uint8_t getValue() const
+        for (auto& result : state->results)
+            if (result) hubs.emplace_back(std::move(result->name), std::move(result->path), std::move(result->file));
+        return hubs;
+    }
+
+    template <class Allocator = std::allocator<Hub>>
+    [[nodiscard]] std::deque<Hub, Allocator> findHubs(const FindOptions& options, const Allocator& allocator = Allocator{})
+    {
+        std::error_code error;
+        auto hubs = findHubs(options, error, allocator);
+        if (error)
+            detail::raise(std::system_error{error, "Failed to enumerate devices"});
+        return hubs;
+    }
+
+    class HubMonitor final
+    {
+    public:
+        HubMonitor(std::function<void(Hub&)> added, std::function<void(Hub&)> removed);
+
+        ~HubMonitor()
         {
-            return processor->readValue(slot);
+#ifdef _WIN32
+            if (window) PostMessageA(window, WM_CLOSE, 0, 0);
+            thread.join();
+#else
+            const std::uint64_t value = 1U;
+            while (::write(stopFd, &value, sizeof(value)) == -1 && errno == EINTR);
+            thread.join();
+            close(socketFd);
+            close(stopFd);
+#endif
         }
 
-        void setValue(std::uint8_t value) const
+        HubMonitor(const HubMonitor&) = delete;
+        HubMonitor& operator=(const HubMonitor&) = delete;
+
+    private:
+        void enumerate()
         {
-            processor->writeValue(slot, value);
+            std::error_code error;
+            for (const auto& path : detail::getCandidatePaths(true, error))
+                add(path);
         }
-        
-    private:
-        static Device::Type getDeviceType(std::uint8_t b)
+
+        void add(const std::string& path)
         {
-            switch (b)
+            for (const auto& hub : hubs)
+                if (isSamePath(hub.getPath(), path)) return;
+
+            std::error_code error;
+            if (auto hub = detail::openHub(path, error))
             {
-            case 38U:
-            case 39U:
-                return Device::Type::tiltSensor;
+                hubs.emplace_back(std::move(hub->name), std::move(hub->path), std::move(hub->file));
+                onAdded(hubs.back());
+            }
+        }
 
-            case 102U:
-            case 103U:
-                return Device::Type::servoMotor;
+        void remove(const std::string& path)
+        {
+            for (auto i = hubs.begin(); i != hubs.end(); ++i)
+                if (isSamePath(i->getPath(), path))
+                {
+                    onRemoved(*i);
+                    hubs.erase(i);
+                    return;
+                }
+        }
 
-            case 177U:
-            case 178U:
-            case 179U:
-            case 180U:
-                return Device::Type::distanceSensor;
+#ifdef _WIN32
+        static bool isSamePath(const std::string& a, const std::string& b) noexcept
+        {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+                [](const char c1, const char c2) noexcept {
+                    return std::tolower(static_cast<unsigned char>(c1)) == std::tolower(static_cast<unsigned char>(c2));
+                });
+        }
 
-            case 202U:
-            case 203U:
-            case 204U:
-            case 205U:
-                return Device::Type::light;
+        static LRESULT CALLBACK windowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+        void run(std::promise<std::error_code> started);
+#else
+        static bool isSamePath(const std::string& a, const std::string& b) noexcept
+        {
+            return a == b;
+        }
 
-            case 231U:
-                return Device::Type::none;
+        void run();
 
-            case 0U:
-            case 1U:
-            case 2U:
-            case 3U:
-            case 239U:
-            case 240U:
-            case 241U:
-                return Device::Type::motor;
+        // the device node is created and given permissions asynchronously by udev
+        void addWithRetry(const std::string& path)
+        {
+            for (int attempt = 0; attempt < 20; ++attempt)
+            {
+                if (access(path.c_str(), R_OK | W_OK) == 0) break;
 
-            default: return Device::Type::none;
+                pollfd stopPollFd{stopFd, POLLIN, 0};
+                if (poll(&stopPollFd, 1, 50) > 0) return;
             }
+
+            add(path);
         }
 
-        std::uint8_t slot = 0;
-        detail::Processor* processor = nullptr;
+        int socketFd = -1;
+        int stopFd = -1;
+#endif
+
+        std::function<void(Hub&)> onAdded;
+        std::function<void(Hub&)> onRemoved;
+        std::list<Hub> hubs;
+        std::thread thread;
+#ifdef _WIN32
+        HWND window = nullptr;
+#endif
     };
 
-    class Hub final
+#ifdef WEDOPP_SOURCES
+    WEDOPP_INLINE HubMonitor::HubMonitor(std::function<void(Hub&)> added, std::function<void(Hub&)> removed):
+        onAdded{std::move(added)}, onRemoved{std::move(removed)}
     {
-    public:
-        Hub(std::string n, std::string p, detail::File f):
-            name{std::move(n)}, path{std::move(p)}, processor{new detail::Processor(std::move(f))}
+#ifdef _WIN32
+        std::promise<std::error_code> started;
+        auto result = started.get_future();
+        thread = std::thread{&HubMonitor::run, this, std::move(started)};
+
+        if (const auto error = result.get())
         {
-            devices.push_back(Device{0U, processor.get()});
-            devices.push_back(Device{1U, processor.get()});
+            thread.join();
+            detail::raise(std::system_error{error, "Failed to monitor devices"});
         }
-        
-        [[nodiscard]] const auto& getName() const noexcept { return name; }
-        [[nodiscard]] const auto& getPath() const noexcept { return path; }
-        [[nodiscard]] const auto& getDevices() const noexcept { return devices; }
+#else
+        socketFd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (socketFd == -1)
+            detail::raise(std::system_error{errno, std::system_category(), "Failed to create netlink socket"});
 
-    private:
-        std::string name;
-        std::string path;
-        std::vector<Device> devices;
-        std::unique_ptr<detail::Processor> processor;
-    };
+        sockaddr_nl address{};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = 1U; // kernel uevents
+        if (bind(socketFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+        {
+            const auto error = errno;
+            close(socketFd);
+            detail::raise(std::system_error{error, std::system_category(), "Failed to bind netlink socket"});
+        }
 
-    [[nodiscard]] std::vector<Hub> findHubs()
-    {
-        constexpr std::int16_t vendorId = 0x0694;
-        constexpr std::int16_t productId = 0x0003;
+        stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (stopFd == -1)
+        {
+            const auto error = errno;
+            close(socketFd);
+            detail::raise(std::system_error{error, std::system_category(), "Failed to create stop event"});
+        }
 
-        std::vector<Hub> hubs;
+        thread = std::thread{&HubMonitor::run, this};
+#endif
+    }
 
 #ifdef _WIN32
-        GUID hidGuid;
-        HidD_GetHidGuid(&hidGuid);
-        detail::DevInfo devInfo{&hidGuid, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE | DIGCF_ALLCLASSES};
+    WEDOPP_INLINE LRESULT CALLBACK HubMonitor::windowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+    {
+        const auto monitor = reinterpret_cast<HubMonitor*>(GetWindowLongPtrA(hwnd, GWLP_USERDATA));
+
+        switch (message)
+        {
+        case WM_DEVICECHANGE:
+            if (monitor && (wParam == DBT_DEVICEARRIVAL || wParam == DBT_DEVICEREMOVECOMPLETE))
+            {
+                const auto header = reinterpret_cast<const DEV_BROADCAST_HDR*>(lParam);
+                if (header && header->dbch_devicetype == DBT_DEVTYP_DEVICEINTERFACE)
+                {
+                    // only WeDo hubs are opened, not every HID device that is plugged in
+                    const auto deviceInterface = reinterpret_cast<const DEV_BROADCAST_DEVICEINTERFACE_A*>(header);
+                    if (wParam == DBT_DEVICEREMOVECOMPLETE)
+                        monitor->remove(deviceInterface->dbcc_name);
+                    else if (detail::matchesHardwareId(deviceInterface->dbcc_name))
+                        monitor->add(deviceInterface->dbcc_name);
+                }
+            }
+            return TRUE;
+
+        case WM_CLOSE:
+            DestroyWindow(hwnd);
+            return 0;
+
+        case WM_DESTROY:
+            PostQuitMessage(0);
+            return 0;
+
+        default:
+            return DefWindowProcA(hwnd, message, wParam, lParam);
+        }
+    }
+
+    WEDOPP_INLINE void HubMonitor::run(std::promise<std::error_code> started)
+    {
+        const auto instance = GetModuleHandleA(nullptr);
+
+        WNDCLASSEXA windowClass{};
+        windowClass.cbSize = sizeof(windowClass);
+        windowClass.lpfnWndProc = windowProc;
+        windowClass.hInstance = instance;
+        windowClass.lpszClassName = "WedoppHubMonitor";
+        RegisterClassExA(&windowClass); // fails harmlessly if already registered
+
+        window = CreateWindowExA(0, windowClass.lpszClassName, "", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, instance, nullptr);
+        if (!window)
+        {
+            started.set_value(std::error_code{static_cast<int>(GetLastError()), std::system_category()});
+            return;
+        }
 
-        for (DWORD index = 0;; ++index)
+        DEV_BROADCAST_DEVICEINTERFACE_A filter{};
+        filter.dbcc_size = sizeof(filter);
+        filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+        HidD_GetHidGuid(&filter.dbcc_classguid);
+
+        const auto notification = RegisterDeviceNotificationA(window, &filter, DEVICE_NOTIFY_WINDOW_HANDLE);
+        if (!notification)
+        {
+            const auto error = GetLastError();
+            DestroyWindow(window);
+            window = nullptr;
+            started.set_value(std::error_code{static_cast<int>(error), std::system_category()});
+            return;
+        }
+
+        SetWindowLongPtrA(window, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+        started.set_value(std::error_code{});
+        enumerate();
+
+        MSG message;
+        while (GetMessageA(&message, nullptr, 0, 0) > 0)
         {
-            SP_DEVICE_INTERFACE_DATA interfaceData{};
-            interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+            TranslateMessage(&message);
+            DispatchMessageA(&message);
+        }
+
+        UnregisterDeviceNotification(notification);
+    }
+#else
+    WEDOPP_INLINE void HubMonitor::run()
+    {
+        enumerate();
 
-            if (!SetupDiEnumDeviceInterfaces(devInfo.get(), nullptr, &hidGuid, index, &interfaceData))
+        std::array<pollfd, 2> pollFds{{{socketFd, POLLIN, 0}, {stopFd, POLLIN, 0}}};
+        std::array<char, 4096> buffer;
+
+        for (;;)
+        {
+            if (poll(pollFds.data(), pollFds.size(), -1) == -1)
             {
-                if (const auto error = GetLastError(); error != ERROR_NO_MORE_ITEMS)
-                    throw std::system_error{static_cast<int>(error), std::system_category(), "Failed to enumerate device interfaces"};
-                else
-                    break;
+                if (errno == EINTR) continue;
+                return;
             }
 
-            DWORD requiredLength = 0;
-            if (!SetupDiGetDeviceInterfaceDetailA(devInfo.get(), &interfaceData, nullptr, 0, &requiredLength, nullptr))
-                if (const auto error = GetLastError(); error != ERROR_INSUFFICIENT_BUFFER)
-                    throw std::system_error{static_cast<int>(error), std::system_category(), "Failed to get interface detail"};
+            if (pollFds[1].revents) return;
 
-            detail::InterfaceDetailData interfaceDetailData{requiredLength};
+            const auto size = recv(socketFd, buffer.data(), buffer.size() - 1U, 0);
+            if (size <= 0) continue;
+            buffer[static_cast<std::size_t>(size)] = '\0';
 
-            if (!SetupDiGetDeviceInterfaceDetailA(devInfo.get(), &interfaceData, interfaceDetailData.get(), requiredLength, &requiredLength, nullptr))
-                throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to get interface detail"};
-            
-            try
+            // the message is "action@devpath" followed by null-terminated KEY=value pairs
+            std::string action;
+            std::string subsystem;
+            std::string deviceName;
+            for (auto i = buffer.data(); i < buffer.data() + size; i += std::strlen(i) + 1U)
+                if (std::strncmp(i, "ACTION=", 7) == 0) action = i + 7;
+                else if (std::strncmp(i, "SUBSYSTEM=", 10) == 0) subsystem = i + 10;
+                else if (std::strncmp(i, "DEVNAME=", 8) == 0) deviceName = i + 8;
+
+            if (subsystem != "usbmisc" || deviceName.compare(0, 7, "usb/hid") != 0)
+                continue;
+
+            // only WeDo hubs are opened, sysfs knows the node by its name without the usb/ directory
+            const auto path = "/dev/" + deviceName;
+            if (action == "add" && detail::matchesHardwareId(deviceName.substr(4)))
+                addWithRetry(path);
+            else if (action == "remove")
+                remove(path);
+        }
+    }
+#endif
+#endif
+    namespace detail
+    {
+        // sleeps until absolute deadlines on the monotonic clock, so that the time spent between sleeps does not add up
+        class DeadlineTimer final
+        {
+        public:
+#ifdef _WIN32
+            DeadlineTimer():
+                handle{CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS)}
             {
-                detail::File file{interfaceDetailData->DevicePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, FILE_FLAG_WRITE_THROUGH};
-                
-                HIDD_ATTRIBUTES attributes{};
-                attributes.Size = sizeof(attributes);
-                if (HidD_GetAttributes(file.get(), &attributes) &&
-                    attributes.VendorID == vendorId && attributes.ProductID == productId)
-                {
-                    WCHAR deviceName[256];
-                    if (!HidD_GetProductString(file.get(), deviceName, sizeof(deviceName)))
-                        throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to get device name"};
+                // high resolution timers are not supported before Windows 10 version 1803
+                if (!handle) handle = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+                if (!handle)
+                    detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to create timer"});
+            }
 
-                    const auto byteCount = WideCharToMultiByte(CP_UTF8, 0, deviceName, -1, nullptr, 0, nullptr, nullptr);
-                    if (byteCount == 0)
-                        throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to convert wide char to UTF-8"};
+            ~DeadlineTimer()
+            {
+                if (handle) CloseHandle(handle);
+            }
 
-                    auto buffer = std::make_unique<char[]>(byteCount);
-                    if (WideCharToMultiByte(CP_UTF8, 0, deviceName, -1, buffer.get(), byteCount, nullptr, nullptr) == 0)
-                        throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to convert wide char to UTF-8"};
+            DeadlineTimer(const DeadlineTimer&) = delete;
+            DeadlineTimer& operator=(const DeadlineTimer&) = delete;
 
-                    hubs.push_back(Hub{buffer.get(), interfaceDetailData->DevicePath, std::move(file)});
-                }
+            [[nodiscard]] static std::chrono::nanoseconds now() noexcept
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
             }
-            catch (const std::system_error&)
+
+            void sleepUntil(const std::chrono::nanoseconds deadline) const noexcept
             {
+                // waitable timers count in 100 ns units and negative values are relative to now
+                LARGE_INTEGER dueTime;
+                dueTime.QuadPart = -static_cast<LONGLONG>((deadline - now()).count() / 100);
+                if (dueTime.QuadPart < 0 && SetWaitableTimer(handle, &dueTime, 0, nullptr, nullptr, FALSE))
+                    WaitForSingleObject(handle, INFINITE);
             }
-        }
+
+        private:
+            HANDLE handle = nullptr;
 #else
-        using CloseDirFunction = int(*)(DIR*);
-        std::unique_ptr<DIR, CloseDirFunction> dir(opendir("/dev/usb"), &closedir);
-        if (!dir)
-            throw std::system_error{errno, std::system_category(), "Failed to open directory"};
+            [[nodiscard]] static std::chrono::nanoseconds now() noexcept
+            {
+                timespec time;
+                clock_gettime(CLOCK_MONOTONIC, &time);
+                return std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec};
+            }
+
+            void sleepUntil(const std::chrono::nanoseconds deadline) const noexcept
+            {
+                const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(deadline);
+                timespec time;
+                time.tv_sec = static_cast<time_t>(seconds.count());
+                time.tv_nsec = static_cast<long>((deadline - seconds).count());
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR);
+            }
+#endif
+        };
+    }
+
+    struct ControlLoopOptions final
+    {
+        std::chrono::nanoseconds period = std::chrono::milliseconds{10};
+        int cpu = -1; // the CPU to pin the thread running the loop to, or -1 to leave it unpinned
+    };
+
+    // every period first writes the outputs computed in the previous one, so that they are applied at a steady rate,
+    // then reads the inputs and computes the next outputs
+    class ControlLoop final
+    {
+    public:
+        ControlLoop(const ControlLoopOptions& o,
+                    std::function<void()> r,
+                    std::function<void()> c,
+                    std::function<void()> w):
+            options{o}, readPhase{std::move(r)}, computePhase{std::move(c)}, writePhase{std::move(w)}
+        {
+            if (options.period <= std::chrono::nanoseconds::zero())
+                detail::raise(std::invalid_argument{"Period must be positive"});
+        }
+
+        ControlLoop(const ControlLoop&) = delete;
+        ControlLoop& operator=(const ControlLoop&) = delete;
+
+        // called from the loop with the number of periods that were skipped because a cycle took too long
+        void onOverrun(std::function<void(std::uint64_t)> callback)
+        {
+            overrunCallback = std::move(callback);
+        }
 
-        while (const dirent* ent = readdir(dir.get()))
+        // the loop finishes the current cycle before returning from run
+        void stop() noexcept
         {
-            if (std::strncmp("hid", ent->d_name, 3) == 0)
+            stopRequested.store(true, std::memory_order_release);
+        }
+
+        void run()
+        {
+            if (options.cpu >= 0) pin();
+
+            const detail::DeadlineTimer timer;
+            auto deadline = timer.now();
+
+            while (!stopRequested.load(std::memory_order_acquire))
             {
-                try
-                {
-                    std::string filename = std::string("/dev/usb/") + ent->d_name;
-                    detail::File file{filename.c_str(), O_RDWR};
+                timer.sleepUntil(deadline);
 
-                    struct hiddev_devinfo devinfo;
-                    if (ioctl(file.get(), HIDIOCGDEVINFO, &devinfo) == -1)
-                        throw std::system_error{errno, std::system_category(), "Failed to get device info"};
+                const auto lateness = (timer.now() - deadline).count();
+                if (lateness > maxLateness.load(std::memory_order_relaxed))
+                    maxLateness.store(lateness, std::memory_order_relaxed);
 
-                    if (devinfo.vendor == vendorId && devinfo.product == productId)
-                    {
-                        char deviceName[256];
-                        if (ioctl(file.get(), HIDIOCGNAME(sizeof(deviceName) - 1), deviceName) == -1)
-                            throw std::system_error{errno, std::system_category(), "Failed to get device name"};
+                if (writePhase) writePhase();
+                if (readPhase) readPhase();
+                if (computePhase) computePhase();
+                cycles.fetch_add(1U, std::memory_order_relaxed);
 
-                        hubs.push_back(Hub{deviceName, filename, std::move(file)});
-                    }
-                }
-                catch (const std::exception& e)
+                deadline += options.period;
+                if (const auto now = timer.now(); now > deadline)
                 {
-                    std::cerr << e.what() << '\n';
+                    const auto missed = static_cast<std::uint64_t>((now - deadline) / options.period) + 1U;
+                    deadline += options.period * missed;
+                    overruns.fetch_add(1U, std::memory_order_relaxed);
+                    missedPeriods.fetch_add(missed, std::memory_order_relaxed);
+                    if (overrunCallback) overrunCallback(missed);
                 }
             }
+
+            stopRequested.store(false, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::uint64_t getCycleCount() const noexcept { return cycles.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t getOverrunCount() const noexcept { return overruns.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t getMissedPeriodCount() const noexcept { return missedPeriods.load(std::memory_order_relaxed); }
+
+        // the longest time a cycle started after its deadline
+        [[nodiscard]] std::chrono::nanoseconds getMaxLateness() const noexcept
+        {
+            return std::chrono::nanoseconds{maxLateness.load(std::memory_order_relaxed)};
         }
+
+    private:
+        void pin() const
+        {
+#ifdef _WIN32
+            if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1U} << options.cpu))
+                detail::raise(std::system_error{static_cast<int>(GetLastError()), std::system_category(), "Failed to set thread affinity"});
+#else
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(static_cast<std::size_t>(options.cpu), &cpus);
+            if (const auto result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); result != 0)
+                detail::raise(std::system_error{result, std::system_category(), "Failed to set thread affinity"});
 #endif
+        }
 
-        return hubs;
-    }
+        ControlLoopOptions options;
+        std::function<void()> readPhase;
+        std::function<void()> computePhase;
+        std::function<void()> writePhase;
+        std::function<void(std::uint64_t)> overrunCallback;
+        std::atomic<bool> stopRequested{false};
+        std::atomic<std::uint64_t> cycles{0U};
+        std::atomic<std::uint64_t> overruns{0U};
+        std::atomic<std::uint64_t> missedPeriods{0U};
+        std::atomic<std::chrono::nanoseconds::rep> maxLateness{0};
+    };
+}
 }
 
 #endif
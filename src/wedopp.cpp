@@ -0,0 +1,2 @@
+#define WEDOPP_IMPLEMENTATION
+#include "wedopp.hpp"